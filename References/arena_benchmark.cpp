@@ -0,0 +1,70 @@
+// ---------------------------------------------------------
+// - File: arena_benchmark                                 -
+// - lazy_stream<> nodes from the heap and from a          -
+// - stream_arena                                          -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+#include "stream_arena.h"
+
+
+// One request: builds, walks and drops many short-lived streams.
+long request(int streams)
+{
+	std::function<long (const long&)> square=[](const long& value){return value*value;};
+	std::function<bool (const long&)> odd=[](const long& value){return value%2!=0;};
+	std::function<long (const long&, const long&)> add=[](const long& accu, const long& value){
+		return accu+value;
+		};
+
+	long accu=0;
+
+	for(int i=0; i<streams; ++i)
+		accu+=lazy_stream<long>::range(i, i+64).map(square).filter(odd).fold_left<long>(0)(add);
+
+	return accu;
+}
+
+
+int main(int argn, char *argc[])
+{
+	int requests=argn>1 ? std::atoi(argc[1]) : 200;
+	const int streams=100;
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	long heap_sum=0;
+	double heap_ms=time_ms([&](){
+		for(int i=0; i<requests; ++i)
+			heap_sum+=request(streams);
+		});
+
+	long arena_sum=0;
+	size_t capacity=0;
+	double arena_ms=time_ms([&](){
+		for(int i=0; i<requests; ++i)
+		{
+			stream_arena arena;				// Released in bulk at the end of the request
+
+			arena_sum+=request(streams);
+			capacity=arena.capacity();
+		}
+		});
+
+	std::cout << requests << " requests of " << streams << " streams" << std::endl;
+	std::cout << "heap:  " << std::setw(9) << heap_ms << "ms, "
+				<< 1e3*heap_ms/requests << "us/request (sum " << heap_sum << ")" << std::endl;
+	std::cout << "arena: " << std::setw(9) << arena_ms << "ms, "
+				<< 1e3*arena_ms/requests << "us/request (sum " << arena_sum << "), "
+				<< capacity/1024 << "KiB per request" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread arena_benchmark.cpp -o arena_benchmark
@@ -0,0 +1,90 @@
+// ---------------------------------------------------------
+// - File: arena_check                                     -
+// - Memoized tails of lazy_stream<> go to the arena of    -
+// - the node forced, not the current one                  -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <vector>
+#include "lazy_stream.h"
+#include "stream_arena.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// [0..n) through an identity map, so that every tail is forced by a generator.
+lazy_stream<long> walked(long n)
+{
+	std::function<long (const long&)> identity=[](const long& value){return value;};
+
+	return lazy_stream<long>::range(0, n).map(identity);
+}
+
+
+int main()
+{
+	// A heap stream forced within an arena scope, then read after the arena is gone
+	{
+		lazy_stream<long> stream=walked(100000);
+		lazy_stream<std::vector<long>> windows=stream.sliding(3);
+
+		{
+			stream_arena arena;
+
+			expect(stream.get(1000)==1000, "heap stream forced in an arena");
+			expect(windows.get(1000)[2]==1002, "heap windows forced in an arena");
+			expect(arena.capacity()==0, "no heap tail in the arena");
+		}
+
+		expect(stream.get(500)==500, "heap stream read after the arena");
+		expect(stream.get(2000)==2000, "heap stream forced after the arena");
+		expect(windows.get(500)[0]==500, "heap windows read after the arena");
+	}
+
+	// An arena stream forced within a nested arena scope, read once the nested arena is gone
+	{
+		stream_arena outer;
+		lazy_stream<long> stream=walked(100000);
+
+		{
+			stream_arena inner;
+
+			expect(stream.get(1000)==1000, "outer stream forced in an inner arena");
+			expect(inner.capacity()==0, "no outer tail in the inner arena");
+		}
+
+		expect(stream.get(500)==500, "outer stream read after the inner arena");
+		expect(outer.capacity()>0, "outer tails in the outer arena");
+	}
+
+	// An arena stream forced on another thread, which must not allocate from the arena
+	{
+		stream_arena arena;
+		lazy_stream<long> stream=walked(100000);
+		size_t capacity=arena.capacity();
+
+		expect(std::async(std::launch::async, [&stream](){return stream.get(10000);}).get()==10000,
+			"arena stream forced on another thread");
+		expect(arena.capacity()==capacity, "no tail of another thread in the arena");
+		expect(stream.get(5000)==5000, "arena stream read back");
+	}
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread arena_check.cpp -o arena_check
@@ -0,0 +1,58 @@
+// ---------------------------------------------------------
+// - File: arithmetic_benchmark                            -
+// - Closed-form get, drop, size and contains of           -
+// - lazy_stream<> arithmetic sequences                    -
+// ---------------------------------------------------------
+
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// get, drop, size and contains at the far end of stream, n elements long.
+long probe(const lazy_stream<long>& stream, long n)
+{
+	long accu=stream.get(n-1)+stream.drop(n-1).head()+long(stream.size());
+
+	if(!stream.contains(3*(n-1)) || stream.contains(3*n-1))
+		throw std::logic_error("Unexpected contains.");
+
+	return accu;
+}
+
+
+int main(int argn, char *argc[])
+{
+	std::function<long (const long&)> same=[](const long& value){return value;};
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	for(long n=1000; n<=1000000; n*=10)
+	{
+		long closed=0;
+		long walked=0;
+
+		// range() is a closed-form sequence; mapping it gives an ordinary stream
+		double closed_ms=time_ms([&](){closed=probe(lazy_stream<long>::range(0, 3*n, 3), n);});
+		double walked_ms=time_ms([&](){walked=probe(lazy_stream<long>::range(0, 3*n, 3).map(same), n);});
+
+		if(closed!=walked)
+			throw std::logic_error("Closed form and walk disagree.");
+
+		std::cout << "n=" << std::setw(8) << n << ": closed form " << std::setw(8) << closed_ms
+					<< "ms, walked " << std::setw(10) << walked_ms << "ms" << std::endl;
+	}
+
+	long n=1000000000000L;
+	double closed_ms=time_ms([n](){probe(lazy_stream<long>::range(0, 3*n, 3), n);});
+
+	std::cout << "n=10^12: closed form " << closed_ms << "ms" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread arithmetic_benchmark.cpp -o arithmetic_benchmark
@@ -0,0 +1,31 @@
+// ---------------------------------------------------------
+// - Function: time_ms                                     -
+// - Wall time of the benchmarks                           -
+// ---------------------------------------------------------
+
+
+// time_ms(fn) runs fn once and gets its wall time in milliseconds, on the
+// high resolution clock. Shared by the benchmarks, which time every
+// variant they compare with it.
+
+
+#ifndef BENCHMARK_TIMER_H
+#define BENCHMARK_TIMER_H
+
+
+#include <chrono>
+#include <functional>
+
+
+// Wall time of fn in ms
+inline double time_ms(const std::function<void ()>& fn)
+{
+	auto t0=std::chrono::high_resolution_clock::now();
+	fn();
+	auto t1=std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(t1-t0).count();
+}
+
+
+#endif
@@ -0,0 +1,107 @@
+// ---------------------------------------------------------
+// - File: checkpoint_benchmark                            -
+// - Restart of the prime sieve of sample.cpp from a       -
+// - checkpoint, against computing it again                -
+// ---------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include "benchmark_timer.h"
+#include "checkpoint_stream.h"
+
+
+// The sieve of sample.cpp: the head of start is prime, and the primes
+// after it are the sieve of the elements of the tail it does not divide.
+lazy_stream<int> sieve(const lazy_stream<int>& start)
+{
+	int head=start.head();
+	lazy_stream<int> temp=start.tail().filter([head](const int& value){return value%head!=0;});
+
+	return lazy_stream<int>(head, [temp](){return sieve(temp);});
+}
+
+
+// Resumes the sieve after the checkpointed primes: the sieve of the numbers
+// after the last of them that none of them divides.
+lazy_stream<int> resume(const lazy_stream<int>& primes)
+{
+	int last=0;
+
+	for(const int& prime : primes)
+		last=prime;
+
+	return sieve(lazy_stream<int>::from(last+1).filter([primes](const int& value) {
+		for(const int& prime : primes)
+		{
+			if(prime>value/prime)
+				return true;
+
+			if(value%prime==0)
+				return false;
+		}
+
+		return true;
+		}));
+}
+
+
+int main(int argn, char *argc[])
+{
+	int n=argn>1 ? std::atoi(argc[1]) : 5000;
+	int more=n/10;
+	std::string path="checkpoint_benchmark.bin";
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	// First run: the sieve up to the n-th prime, then checkpointed
+	lazy_stream<int> primes=sieve(lazy_stream<int>::from(2));
+	int last=0;
+	size_t written=0;
+
+	double sieve_ms=time_ms([&](){last=primes.get(n-1);});
+	double checkpoint_ms=time_ms([&](){written=checkpoint(primes, path);});
+
+	if(written!=size_t(n))
+		throw std::logic_error("Unexpected checkpoint.");
+
+	std::cout << "sieve to prime " << n << " (" << last << "): " << std::setw(10) << sieve_ms << "ms" << std::endl;
+	std::cout << "checkpoint:                   " << std::setw(10) << checkpoint_ms << "ms" << std::endl;
+
+	// Restart: the same prefix from the checkpoint
+	std::optional<lazy_stream<int>> restored;
+	int restored_last=0;
+	double restore_ms=time_ms([&](){
+		restored.emplace(checkpointed<int>(path, resume));
+		restored_last=restored->get(n-1);
+		});
+
+	if(restored_last!=last)
+		throw std::logic_error("Unexpected restored prime.");
+
+	std::cout << "restore to prime " << n << ":        " << std::setw(10) << restore_ms << "ms" << std::endl;
+
+	// Then on, past the checkpoint
+	int next=0;
+	int restored_next=0;
+
+	double sieve_more_ms=time_ms([&](){next=primes.get(n+more-1);});
+	double resume_more_ms=time_ms([&](){restored_next=restored->get(n+more-1);});
+
+	if(restored_next!=next)
+		throw std::logic_error("Unexpected resumed prime.");
+
+	std::cout << more << " more primes: sieve " << std::setw(10) << sieve_more_ms << "ms, resumed "
+				<< std::setw(10) << resume_more_ms << "ms" << std::endl;
+
+	std::remove(path.c_str());
+
+	return 0;
+}
+
+// compile this> g++ -std=c++17 -O2 -pthread checkpoint_benchmark.cpp -o checkpoint_benchmark
@@ -0,0 +1,419 @@
+// ---------------------------------------------------------
+// - Checkpoints of evaluated lazy_stream<> prefixes       -
+// - (POSIX, C++17)                                        -
+// ---------------------------------------------------------
+
+
+// checkpoint writes the elements of a stream evaluated so far to a file,
+// and checkpointed maps such a file back as a stream whose prefix is those
+// elements, followed by the rest of the stream recomputed from them: a
+// long or expensive prefix survives a restart of the program without
+// being evaluated again.
+//
+// Trivially copyable elements are stored as raw bytes and used in place in
+// the mapping. Others are stored as records of the bytes their
+// lazy_stream_serializer<T> specialization writes, and rebuilt as their
+// nodes are evaluated. Either way a checkpoint is only meant to be read
+// back on the same platform, with the same layout of T.
+//
+// Addresses do not survive a restart, so pointers and views such as
+// std::string_view, even trivially copyable, are never stored raw: they
+// need a lazy_stream_serializer<T> that writes what they point to, and
+// fail to compile otherwise. So do pairs, tuples and arrays of them. A
+// struct with a pointer member cannot be told apart from plain data, and
+// must not be checkpointed without a serializer either.
+
+
+#ifndef CHECKPOINT_STREAM_H
+#define CHECKPOINT_STREAM_H
+
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+#include "mapped_stream.h"
+
+
+// Serialization of the checkpointed elements of a type that is not trivially copyable
+//
+// Specialize it for T, with enabled true and:
+// static void write(std::string& out, const T& value);	appends the bytes of value to out
+// static T read(const char* data, size_t size);			rebuilds a value from its bytes
+//
+template <typename T>
+struct lazy_stream_serializer
+{
+	static const bool enabled=false;
+};
+
+// Strings are stored as their characters
+template <>
+struct lazy_stream_serializer<std::string>
+{
+	static const bool enabled=true;
+
+	static void write(std::string& out, const std::string& value) {out+=value;}
+
+	static std::string read(const char* data, size_t size) {return std::string(data, size);}
+};
+
+
+namespace checkpoint_stream_detail
+{
+
+// Header of a checkpoint file, whose elements start at offset_
+struct checkpoint_header
+{
+	char magic_[8];
+	uint32_t version_;
+	uint32_t serialized_;		// Records of serialized elements rather than raw ones
+	uint64_t element_size_;		// sizeof of the raw elements
+	uint64_t count_;
+	uint64_t offset_;			// Aligned for the raw elements
+	uint64_t complete_;			// Was the end of the stream reached?
+};
+
+const char checkpoint_magic[8]={'L', 'Z', 'S', 'T', 'R', 'E', 'A', 'M'};
+
+// Does T hold an address, meaningless once the program restarts?
+template <typename T>
+struct holds_address : std::integral_constant<bool,
+	std::is_pointer<T>::value || std::is_member_pointer<T>::value> {};
+
+template <typename Char, typename Traits>
+struct holds_address<std::basic_string_view<Char, Traits>> : std::true_type {};
+
+template <typename T>
+struct holds_address<std::reference_wrapper<T>> : std::true_type {};
+
+template <typename T, size_t N>
+struct holds_address<std::array<T, N>> : holds_address<T> {};
+
+template <typename U, typename V>
+struct holds_address<std::pair<U, V>> : std::disjunction<holds_address<U>, holds_address<V>> {};
+
+template <typename... Ts>
+struct holds_address<std::tuple<Ts...>> : std::disjunction<holds_address<Ts>...> {};
+
+template <typename T>
+struct holds_address<const T> : holds_address<T> {};
+
+// Are the elements of type T checkpointed as raw bytes, rather than serialized?
+template <typename T>
+using raw_type=std::integral_constant<bool, std::is_trivially_copyable<T>::value && !holds_address<T>::value>;
+
+// Writes a checkpoint to a temporary file, renamed to its path once complete
+class checkpoint_writer
+{
+	static const size_t buffer_size=size_t(1)<<16;
+
+	std::string path_;
+	std::string temp_path_;
+	std::FILE* file_;					// Null once committed
+	std::vector<unsigned char> buffer_;
+
+	// Writes the buffer to the file
+	void flush()
+	{
+		if(!buffer_.empty() && std::fwrite(buffer_.data(), 1, buffer_.size(), file_)!=buffer_.size())
+			throw std::runtime_error("Function: checkpoint. Cannot write "+path_+".");
+
+		buffer_.clear();
+	}
+
+public:
+
+	// Opens the temporary file, leaving offset bytes for the header
+	checkpoint_writer(const std::string& path, size_t offset) :
+	path_(path),
+	temp_path_(path+".tmp"),
+	file_(std::fopen(temp_path_.c_str(), "wb")),
+	buffer_(offset, 0)
+	{
+		if(!file_)
+			throw std::runtime_error("Function: checkpoint. Cannot write "+path+".");
+	}
+
+	checkpoint_writer(const checkpoint_writer&)=delete;
+	checkpoint_writer& operator=(const checkpoint_writer&)=delete;
+
+	// Drops the temporary file if it was not committed
+	~checkpoint_writer()
+	{
+		if(file_)
+		{
+			std::fclose(file_);
+			std::remove(temp_path_.c_str());
+		}
+	}
+
+	// Appends bytes bytes
+	void append(const void* data, size_t bytes)
+	{
+		const unsigned char* first=static_cast<const unsigned char*>(data);
+
+		buffer_.insert(buffer_.end(), first, first+bytes);
+
+		if(buffer_.size()>=buffer_size)
+			flush();
+	}
+
+	// Writes header at the start and replaces the file at path with the temporary one
+	void commit(const checkpoint_header& header)
+	{
+		flush();
+
+		bool written=std::fseek(file_, 0, SEEK_SET)==0 && std::fwrite(&header, sizeof(header), 1, file_)==1;
+
+		written=std::fclose(file_)==0 && written;
+		file_=nullptr;
+
+		if(!written || std::rename(temp_path_.c_str(), path_.c_str())!=0)
+		{
+			std::remove(temp_path_.c_str());
+			throw std::runtime_error("Function: checkpoint. Cannot write "+path_+".");
+		}
+	}
+};
+
+// Checkpoint file restored, shared by the nodes of its prefix
+template <typename T>
+struct restore_state : std::enable_shared_from_this<restore_state<T>>
+{
+	std::shared_ptr<const mapped_file> file_ptr_;
+	const char* data_;				// First element
+	size_t size_;					// Bytes from data_ to the end of the file
+	size_t count_;
+	bool complete_;
+	std::function<lazy_stream<T> (const lazy_stream<T>&)> resume_fn_;
+};
+
+// Appends the bytes of value to a checkpoint
+template <typename T>
+void append(checkpoint_writer& writer, const T& value, std::true_type)
+{
+	writer.append(&value, sizeof(T));
+}
+
+// Appends the size and the serialized bytes of value to a checkpoint
+template <typename T>
+void append(checkpoint_writer& writer, const T& value, std::false_type)
+{
+	static_assert(lazy_stream_serializer<T>::enabled,
+		"checkpoint: T is not trivially copyable, or holds pointers or views, and has no lazy_stream_serializer<T>.");
+
+	std::string bytes;
+
+	lazy_stream_serializer<T>::write(bytes, value);
+
+	uint64_t size=bytes.size();
+
+	writer.append(&size, sizeof(size));
+	writer.append(bytes.data(), bytes.size());
+}
+
+template <typename T>
+lazy_stream<T> restore_prefix(const std::shared_ptr<restore_state<T>>& state_ptr, std::true_type);
+
+template <typename T>
+lazy_stream<T> restore_prefix(const std::shared_ptr<restore_state<T>>& state_ptr, std::false_type);
+
+// Creates the stream following the checkpointed elements
+//
+// resume_fn gets a prefix of its own, sharing the mapped file, which ends
+// with the checkpointed elements instead of resuming again.
+//
+template <typename T>
+lazy_stream<T> restore_resume(const std::shared_ptr<restore_state<T>>& state_ptr)
+{
+	if(state_ptr->complete_ || !state_ptr->resume_fn_)
+		return lazy_stream<T>();
+
+	std::shared_ptr<restore_state<T>> prefix_ptr=std::make_shared<restore_state<T>>();
+
+	prefix_ptr->file_ptr_=state_ptr->file_ptr_;
+	prefix_ptr->data_=state_ptr->data_;
+	prefix_ptr->size_=state_ptr->size_;
+	prefix_ptr->count_=state_ptr->count_;
+	prefix_ptr->complete_=true;
+
+	return state_ptr->resume_fn_(restore_prefix(prefix_ptr, raw_type<T>()));
+}
+
+// Creates the stream of the raw elements from index on, then of the resumed ones
+//
+// Every node shares the ownership of the checkpoint through its head,
+// which points into the mapped file, so the tail generator only captures
+// a raw pointer and the index: small enough for std::function to hold
+// them without a heap allocation.
+//
+template <typename T>
+lazy_stream<T> restore_pull(restore_state<T>* state, size_t index)
+{
+	if(index>=state->count_)
+		return restore_resume(state->shared_from_this());
+
+	const T* element=reinterpret_cast<const T*>(state->data_)+index;
+
+	return lazy_stream<T>::from_shared(std::shared_ptr<T>(state->shared_from_this(), const_cast<T*>(element)),
+		[state, index]() {
+			return restore_pull(state, index+1);
+			});
+}
+
+// Creates the stream of the serialized elements from index on, at offset, then of the resumed ones
+template <typename T>
+lazy_stream<T> restore_records(const std::shared_ptr<restore_state<T>>& state_ptr, size_t index, size_t offset)
+{
+	const restore_state<T>& state=*state_ptr;
+	uint64_t size=0;
+
+	if(index>=state.count_)
+		return restore_resume(state_ptr);
+
+	// offset never passes the end: every record read so far fit in the file
+	if(state.size_-offset<sizeof(size))
+		throw std::runtime_error("Function: checkpointed. Truncated checkpoint.");
+
+	std::memcpy(&size, state.data_+offset, sizeof(size));
+	offset+=sizeof(size);
+
+	if(state.size_-offset<size)
+		throw std::runtime_error("Function: checkpointed. Truncated checkpoint.");
+
+	size_t next=offset+size_t(size);
+
+	return lazy_stream<T>(lazy_stream_serializer<T>::read(state.data_+offset, size_t(size)),
+		[state_ptr, index, next]() {
+			return restore_records(state_ptr, index+1, next);
+			});
+}
+
+// Creates the stream of the raw checkpointed elements, then of the resumed ones
+template <typename T>
+lazy_stream<T> restore_prefix(const std::shared_ptr<restore_state<T>>& state_ptr, std::true_type)
+{
+	return restore_pull(state_ptr.get(), 0);
+}
+
+// Creates the stream of the serialized checkpointed elements, then of the resumed ones
+template <typename T>
+lazy_stream<T> restore_prefix(const std::shared_ptr<restore_state<T>>& state_ptr, std::false_type)
+{
+	static_assert(lazy_stream_serializer<T>::enabled,
+		"checkpointed: T is not trivially copyable, or holds pointers or views, and has no lazy_stream_serializer<T>.");
+
+	return restore_records(state_ptr, 0, 0);
+}
+
+}	// namespace checkpoint_stream_detail
+
+
+// Writes the evaluated prefix of stream to a checkpoint file at path. Returns its number of elements.
+//
+// Only the elements already evaluated are written: nothing is forced, so
+// force the prefix to save first, e.g. with get(n-1). The end of the
+// stream is recorded too once evaluated.
+//
+// The file is written to path.tmp, then renamed to path once complete, so
+// a crash while writing leaves any previous checkpoint at path as it was.
+//
+template <typename T>
+size_t checkpoint(const lazy_stream<T>& stream, const std::string& path)
+{
+	typedef checkpoint_stream_detail::raw_type<T> raw_type;
+
+	const size_t offset=std::max(size_t(64), size_t(alignof(T)));
+	checkpoint_stream_detail::checkpoint_writer writer(path, offset);
+	checkpoint_stream_detail::checkpoint_header header=checkpoint_stream_detail::checkpoint_header();
+	const lazy_stream<T>* node=&stream;
+
+	while(node && !node->empty())
+	{
+		checkpoint_stream_detail::append(writer, node->head(), raw_type());
+		++header.count_;
+		node=node->evaluated_tail();
+	}
+
+	std::memcpy(header.magic_, checkpoint_stream_detail::checkpoint_magic, sizeof(header.magic_));
+	header.version_=1;
+	header.serialized_=raw_type::value ? 0 : 1;
+	header.element_size_=raw_type::value ? sizeof(T) : 0;
+	header.offset_=offset;
+	header.complete_=node ? 1 : 0;
+
+	writer.commit(header);
+
+	return size_t(header.count_);
+}
+
+
+// Creates the stream of the elements checkpointed at path, followed by the stream resume_fn creates from them
+//
+// The file is mapped in memory, not read: raw elements are used in place
+// by the nodes of the stream, and serialized ones rebuilt as their nodes
+// are evaluated, so restoring costs a file map instead of recomputing
+// the prefix.
+//
+// Past the checkpointed elements, the stream goes on with
+// resume_fn(prefix), prefix being the stream of those elements only: the
+// generator of the original stream, started again from the state they
+// give. The sieve of sample.cpp, say, resumes as the sieve of the numbers
+// after the last prime in prefix that no prime in prefix divides.
+// resume_fn is called once, when that tail is first forced. The stream
+// ends with the checkpointed elements if the checkpoint holds the end of
+// the stream, or if resume_fn is empty.
+//
+template <typename T>
+lazy_stream<T> checkpointed(const std::string& path,
+	const std::function<lazy_stream<T> (const lazy_stream<T>& prefix)>& resume_fn=nullptr)
+{
+	typedef checkpoint_stream_detail::raw_type<T> raw_type;
+
+	std::shared_ptr<checkpoint_stream_detail::restore_state<T>> state_ptr=
+		std::make_shared<checkpoint_stream_detail::restore_state<T>>();
+	checkpoint_stream_detail::restore_state<T>& state=*state_ptr;
+	checkpoint_stream_detail::checkpoint_header header;
+
+	state.file_ptr_=std::make_shared<const mapped_file>(path);
+
+	const mapped_file& file=*state.file_ptr_;
+
+	if(file.size()>=sizeof(header))
+		std::memcpy(&header, file.data(), sizeof(header));
+
+	if(file.size()<sizeof(header) ||
+		std::memcmp(header.magic_, checkpoint_stream_detail::checkpoint_magic, sizeof(header.magic_))!=0 ||
+		header.version_!=1 ||
+		header.serialized_!=(raw_type::value ? 0 : 1) ||
+		header.element_size_!=(raw_type::value ? sizeof(T) : 0) ||
+		header.offset_>file.size() || header.offset_%alignof(T)!=0)
+		throw std::runtime_error("Function: checkpointed. Not a checkpoint of this element type: "+path+".");
+
+	state.data_=file.data()+header.offset_;
+	state.size_=file.size()-size_t(header.offset_);
+	state.count_=size_t(header.count_);
+	state.complete_=header.complete_!=0;
+	state.resume_fn_=resume_fn;
+
+	if(raw_type::value && state.size_/sizeof(T)<state.count_)
+		throw std::runtime_error("Function: checkpointed. Truncated checkpoint: "+path+".");
+
+	return checkpoint_stream_detail::restore_prefix(state_ptr, raw_type());
+}
+
+
+#endif
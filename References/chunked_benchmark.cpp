@@ -0,0 +1,91 @@
+// ---------------------------------------------------------
+// - File: chunked_benchmark                               -
+// - lazy_stream<> against chunked_stream<> layouts        -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include "benchmark_timer.h"
+#include "chunked_stream.h"
+#include "lazy_stream.h"
+
+
+// Number of heap allocations done so far.
+static size_t allocations=0;
+
+
+void* operator new(size_t size)
+{
+	++allocations;
+
+	if(void* ptr=std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+
+// Runs range(0, n).map(x*3).filter(even).take(n/2) folded into a sum and
+// prints its time and allocations per element of the source range.
+template <typename F>
+void report(const char* name, long n, F fn)
+{
+	size_t allocations_0=allocations;
+	long sum=0;
+	double ms=time_ms([&](){sum=fn();});
+
+	std::cout << std::setw(22) << name << ": "
+				<< std::setw(9) << ms << "ms, "
+				<< std::setw(8) << 1e6*ms/n << "ns/elem, "
+				<< std::setw(7) << double(allocations-allocations_0)/n << " allocs/elem"
+				<< " (sum " << sum << ")" << std::endl;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 100000;
+
+	std::function<long (const long&)> triple=[](const long& value){return value*3;};
+	std::function<bool (const long&)> even=[](const long& value){return value%2==0;};
+	std::function<long (const long&, const long&)> add=[](const long& accu, const long& value){
+		return accu+value;
+		};
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	report("lazy_stream", n, [&](){
+		return lazy_stream<long>::range(0, n).map(triple).filter(even).take(n/2).fold_left<long>(0)(add);
+		});
+
+	for(size_t chunk_size=64; chunk_size<=4096; chunk_size*=4)
+	{
+		std::string name="chunked_stream<"+std::to_string(chunk_size)+">";
+
+		report(name.c_str(), n, [&](){
+			return chunked_stream<long>::range(0, n, chunk_size)
+						.map(triple).filter(even).take(n/2).fold_left<long>(0)(add);
+			});
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread chunked_benchmark.cpp -o chunked_benchmark
@@ -0,0 +1,426 @@
+// ---------------------------------------------------------
+// - Class: chunked_stream<>                               -
+// - Immutable stream with non-strict evaluation whose     -
+// - nodes hold contiguous blocks of elements              -
+// ---------------------------------------------------------
+
+
+// A lazy_stream<> node costs two or three heap allocations per element.
+// chunked_stream<> keeps the same lazy, memoized, immutable semantics but
+// every node holds up to chunk_size elements in one std::vector, so the
+// allocations and the pointer chasing are paid once per block and the
+// operators below run over contiguous memory.
+//
+// The chunks are the elements of a lazy_stream<std::vector<T>>, so a
+// chunked_stream<> shares its safeguards: a tail is forced once even when
+// several threads read it concurrently, and a long chain of forced chunks is
+// destroyed in constant stack.
+//
+// Non-empty streams never hold empty chunks.
+
+
+#ifndef CHUNKED_STREAM_H
+#define CHUNKED_STREAM_H
+
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+
+
+template <typename T>
+class chunked_stream
+{
+	typedef std::vector<T> chunk_type;
+
+	// Stream of the chunks, one per node. Its tail generators are released
+	// once the tails have been forced and memoized.
+	typedef lazy_stream<chunk_type> chunks_type;
+
+	typedef std::function<chunked_stream<T> ()> tail_gen_type;
+
+	typedef std::function<bool (const T&)> predicate_fn_type;
+
+	template <typename U>
+	friend class chunked_stream;
+
+	chunks_type chunks_;				// Never holds an empty chunk
+
+	// Wraps a stream of non-empty chunks (private)
+	static chunked_stream<T> from_chunks(chunks_type chunks);
+
+	// Selects the elements satisfying filter_fn from position on (private)
+	static chunked_stream<T> filter_from(chunks_type position, const predicate_fn_type& filter_fn);
+
+	// Takes the first n elements from position on (private)
+	static chunked_stream<T> take_from(const chunks_type& position, size_t n);
+
+	// Maps the elements from position on (private)
+	template <typename U>
+	static chunked_stream<U> map_from(const chunks_type& position, const std::function<U (const T&)>& map_fn);
+
+public:
+
+	// Default number of elements per chunk
+	static const size_t default_chunk_size=256;
+
+	// Creates the stream: {n, n+1, n+2,...}
+	static chunked_stream<T> from(const T& n, size_t chunk_size=default_chunk_size);
+
+	// Creates the stream: {n, n+step, n+2*step,...}
+	static chunked_stream<T> from(const T& n, const T& step, size_t chunk_size);
+
+	// Creates the stream: [from..to)
+	static chunked_stream<T> range(const T& from, const T& to, size_t chunk_size=default_chunk_size);
+
+	// Creates the stream: [from..to) with a step
+	static chunked_stream<T> range(const T& from, const T& to, const T& step, size_t chunk_size);
+
+	// Empty stream constructor
+	chunked_stream() {}
+
+	// Creates a stream from a last chunk, empty for the empty stream
+	explicit chunked_stream(chunk_type chunk);
+
+	// Creates a stream from a non-empty chunk and the generator of the following chunks
+	chunked_stream(chunk_type chunk, tail_gen_type tail_gen);
+
+	// Gets the stream first chunk
+	auto chunk() const -> const chunk_type&;
+
+	// Gets the stream first element (head)
+	auto head() const -> const T&;
+
+	// Creates the tail substream by removing the first chunk
+	chunked_stream<T> tail() const;
+
+	// Is the stream empty?
+	bool empty() const {return chunks_.empty();}
+
+	// Gets the number of elements in the stream
+	size_t size() const;
+
+	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+	chunked_stream<T> filter(const predicate_fn_type& filter_fn) const;
+
+	// Creates the substream of the first n elements
+	chunked_stream<T> take(size_t n) const;
+
+	// Pours the stream into a std::list
+	std::list<T> to_list() const;
+
+	// Creates a stream by applying the map_fn map
+	template <typename U>
+	chunked_stream<U> map(const std::function<U (const T&)>& map_fn) const;
+
+	// Fold left reduction
+	template <typename U>
+	std::function<U (const std::function<U (const U&, const T&)>&)> fold_left(const U& start) const;
+};
+
+
+// Default number of elements per chunk
+template <typename T>
+const size_t chunked_stream<T>::default_chunk_size;
+
+
+// Creates the stream: {n, n+1, n+2,...}
+template <typename T>
+chunked_stream<T> chunked_stream<T>::from(const T& n, size_t chunk_size)
+{
+	return from(n, T(1), chunk_size);
+}
+
+
+// Creates the stream: {n, n+step, n+2*step,...}
+template <typename T>
+chunked_stream<T> chunked_stream<T>::from(const T& n, const T& step, size_t chunk_size)
+{
+	if(chunk_size<1)
+		throw std::invalid_argument("Class: chunked_stream<>. Chunk size must be positive.");
+
+	chunk_type chunk;
+	chunk.reserve(chunk_size);
+
+	T value=n;
+
+	for(size_t i=0; i<chunk_size; ++i, value+=step)
+		chunk.push_back(value);
+
+	return chunked_stream<T>(std::move(chunk), [value, step, chunk_size]() -> chunked_stream<T> {
+		return chunked_stream<T>::from(value, step, chunk_size);
+		});
+}
+
+
+// Creates the stream: [from..to)
+template <typename T>
+chunked_stream<T> chunked_stream<T>::range(const T& from, const T& to, size_t chunk_size)
+{
+	if(to>from)
+		return range(from, to, T(1), chunk_size);
+
+	if(from>to)
+		return range(from, to, T(-1), chunk_size);
+
+	return chunked_stream<T>();
+}
+
+
+// Creates the stream: [from..to) with a step
+template <typename T>
+chunked_stream<T> chunked_stream<T>::range(const T& from, const T& to, const T& step, size_t chunk_size)
+{
+	if(chunk_size<1)
+		throw std::invalid_argument("Class: chunked_stream<>. Chunk size must be positive.");
+
+	chunk_type chunk;
+	chunk.reserve(chunk_size);
+
+	T value=from;
+
+	for(; chunk.size()<chunk_size; value+=step)
+	{
+		if(!((to>value && step>=T(0)) || (value>to && step<=T(0))))
+			return chunked_stream<T>(std::move(chunk));
+
+		chunk.push_back(value);
+	}
+
+	return chunked_stream<T>(std::move(chunk), [value, to, step, chunk_size]() -> chunked_stream<T> {
+		return chunked_stream<T>::range(value, to, step, chunk_size);
+		});
+}
+
+
+// Creates a stream from a last chunk, empty for the empty stream
+template <typename T>
+chunked_stream<T>::chunked_stream(chunk_type chunk) :
+chunks_(chunk.empty() ? chunks_type() : chunks_type(std::move(chunk), chunks_type())) {}
+
+
+// Creates a stream from a non-empty chunk and the generator of the following chunks
+//
+// An empty chunk followed by a generator is rejected: skipping it would
+// mean forcing the generator here, once per empty chunk, each call
+// constructing the next stream in turn, with no bound on the recursion.
+// A generator with nothing to yield yet returns its own tail instead.
+//
+template <typename T>
+chunked_stream<T>::chunked_stream(chunk_type chunk, tail_gen_type tail_gen)
+{
+	if(chunk.empty())
+	{
+		if(tail_gen)
+			throw std::invalid_argument("Class: chunked_stream<>. Empty chunk before a tail generator.");
+
+		return;
+	}
+
+	if(!tail_gen)
+		chunks_=chunks_type(std::move(chunk), chunks_type());
+	else
+		chunks_=chunks_type(std::move(chunk), [tail_gen]() -> chunks_type {return tail_gen().chunks_;});
+}
+
+
+// Wraps a stream of non-empty chunks (private)
+template <typename T>
+chunked_stream<T> chunked_stream<T>::from_chunks(chunks_type chunks)
+{
+	chunked_stream<T> accu;
+
+	accu.chunks_=std::move(chunks);
+
+	return accu;
+}
+
+
+// Gets the stream first chunk
+template <typename T>
+auto chunked_stream<T>::chunk() const -> const chunk_type&
+{
+	if(chunks_.empty())
+		throw std::range_error("Class: chunked_stream<>. No chunk in empty stream.");
+
+	return chunks_.head();
+}
+
+
+// Gets the stream first element (head)
+template <typename T>
+auto chunked_stream<T>::head() const -> const T&
+{
+	if(chunks_.empty())
+		throw std::range_error("Class: chunked_stream<>. No head in empty stream.");
+
+	return chunks_.head().front();
+}
+
+
+// Creates the tail substream by removing the first chunk
+//
+// The tail is forced once, even by concurrent readers, as in lazy_stream<>.
+//
+template <typename T>
+chunked_stream<T> chunked_stream<T>::tail() const
+{
+	if(chunks_.empty())
+		throw std::range_error("Class: chunked_stream<>. No tail in empty stream.");
+
+	return from_chunks(chunks_.tail());
+}
+
+
+// Gets the number of elements in the stream
+template <typename T>
+size_t chunked_stream<T>::size() const
+{
+	size_t accu=0;
+
+	for(const chunk_type& chunk : chunks_)
+		accu+=chunk.size();
+
+	return accu;
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+//
+// Chunks whose elements are all rejected are skipped, so the resulting
+// chunks may be shorter than the source ones but are never empty.
+//
+template <typename T>
+chunked_stream<T> chunked_stream<T>::filter(const predicate_fn_type& filter_fn) const
+{
+	return filter_from(chunks_, filter_fn);
+}
+
+
+// Selects the elements satisfying filter_fn from position on (private)
+//
+// The rejected chunks are skipped in a loop, and the generator only holds
+// the chunks after the one kept.
+//
+template <typename T>
+chunked_stream<T> chunked_stream<T>::filter_from(chunks_type position, const predicate_fn_type& filter_fn)
+{
+	for(; !position.empty(); position=position.tail())
+	{
+		chunk_type chunk;
+
+		for(const T& value : position.head())
+			if(filter_fn(value))
+				chunk.push_back(value);
+
+		if(!chunk.empty())
+		{
+			chunks_type rest(position.tail());
+
+			return from_chunks(chunks_type(std::move(chunk), [rest, filter_fn]() -> chunks_type {
+				return filter_from(rest, filter_fn).chunks_;
+				}));
+		}
+	}
+
+	return chunked_stream<T>();
+}
+
+
+// Creates the substream of the first n elements
+template <typename T>
+chunked_stream<T> chunked_stream<T>::take(size_t n) const
+{
+	return take_from(chunks_, n);
+}
+
+
+// Takes the first n elements from position on (private)
+template <typename T>
+chunked_stream<T> chunked_stream<T>::take_from(const chunks_type& position, size_t n)
+{
+	if(position.empty() || n<1)
+		return chunked_stream<T>();
+
+	const chunk_type& chunk=position.head();
+
+	if(n<=chunk.size())
+		return chunked_stream<T>(chunk_type(chunk.begin(), chunk.begin()+n));
+
+	size_t rest=n-chunk.size();
+
+	return from_chunks(chunks_type(chunk, [position, rest]() -> chunks_type {
+		return take_from(position.tail(), rest).chunks_;
+		}));
+}
+
+
+// Pours the stream into a std::list
+template <typename T>
+std::list<T> chunked_stream<T>::to_list() const
+{
+	std::list<T> accu;
+
+	for(const chunk_type& chunk : chunks_)
+		accu.insert(accu.end(), chunk.begin(), chunk.end());
+
+	return accu;
+}
+
+
+// Creates a stream by applying the map_fn map
+template <typename T>
+template <typename U>
+chunked_stream<U> chunked_stream<T>::map(const std::function<U (const T&)>& map_fn) const
+{
+	return map_from(chunks_, map_fn);
+}
+
+
+// Maps the elements from position on (private)
+template <typename T>
+template <typename U>
+chunked_stream<U> chunked_stream<T>::map_from(const chunks_type& position, const std::function<U (const T&)>& map_fn)
+{
+	if(position.empty())
+		return chunked_stream<U>();
+
+	std::vector<U> chunk;
+	chunk.reserve(position.head().size());
+
+	for(const T& value : position.head())
+		chunk.push_back(map_fn(value));
+
+	return chunked_stream<U>::from_chunks(lazy_stream<std::vector<U>>(std::move(chunk),
+		[position, map_fn]() -> lazy_stream<std::vector<U>> {
+			return map_from(position.tail(), map_fn).chunks_;
+			}));
+}
+
+
+// Fold left reduction
+//
+// Same sequence as lazy_stream<>::fold_left, run over one chunk at a time.
+//
+template <typename T>
+template <typename U>
+std::function<U (const std::function<U (const U&, const T&)>&)> chunked_stream<T>::fold_left(const U& start) const
+{
+	chunks_type chunks=chunks_;
+
+	return [chunks, start](const std::function<U (const U&, const T&)>& fold_fn) -> U {
+		U accu=start;
+
+		for(const chunk_type& chunk : chunks)
+			for(const T& value : chunk)
+				accu=fold_fn(accu, value);
+
+		return accu;
+		};
+}
+
+#endif
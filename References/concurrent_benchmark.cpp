@@ -0,0 +1,103 @@
+// ---------------------------------------------------------
+// - File: concurrent_benchmark                            -
+// - Threads sharing one lazy_stream<> prefix              -
+// ---------------------------------------------------------
+
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// Number of times the map function has been evaluated.
+static std::atomic<long> map_calls(0);
+
+
+// Some work per element, about a microsecond.
+long costly(const long& value)
+{
+	++map_calls;
+
+	unsigned long hash=value;
+
+	for(int i=0; i<256; ++i)
+		hash=hash*6364136223846793005UL+1442695040888963407UL;
+
+	return long(hash>>33);
+}
+
+
+// Every thread sums the first n elements of stream, walking it by reference.
+// Returns the wall time in ms.
+double run(const lazy_stream<long>& stream, long n, int threads)
+{
+	std::atomic<bool> go(false);
+	std::vector<std::thread> workers;
+	std::vector<long> sums(threads);
+
+	for(int id=0; id<threads; ++id)
+		workers.emplace_back([&stream, &go, &sums, n, id](){
+			while(!go)
+				std::this_thread::yield();
+
+			const lazy_stream<long>* temp=&stream;
+			long sum=0;
+
+			for(long i=0; i<n; ++i, temp=&temp->tail())
+				sum+=temp->head();
+
+			sums[id]=sum;
+			});
+
+	double ms=time_ms([&](){
+		go=true;
+
+		for(std::thread& worker : workers)
+			worker.join();
+		});
+
+	for(long sum : sums)
+		if(sum!=sums[0])
+			throw std::logic_error("Threads disagree on the stream contents.");
+
+	return ms;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 20000;
+
+	std::function<long (const long&)> map_fn=costly;
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	for(int threads=1; threads<=64; threads*=2)
+	{
+		lazy_stream<long> stream=lazy_stream<long>::from(0).map(map_fn);
+
+		// All the threads race to force the same unevaluated tails...
+		map_calls=0;
+		double cold=run(stream, n, threads);
+		long calls=map_calls;
+
+		// ...and then walk the ready prefix again.
+		double hot=run(stream, n, threads);
+
+		std::cout << std::setw(2) << threads << " threads: forcing "
+					<< std::setw(9) << cold << "ms (" << calls << " map calls for "
+					<< n << " elements), ready "
+					<< std::setw(8) << hot << "ms, "
+					<< std::setw(7) << 1e6*hot/(n*threads) << "ns/elem/thread" << std::endl;
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread concurrent_benchmark.cpp -o concurrent_benchmark
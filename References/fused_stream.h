@@ -0,0 +1,349 @@
+// ---------------------------------------------------------
+// - Class: fused_stream<>                                 -
+// - Pull-based pipeline fusing lazy_stream<> operators    -
+// ---------------------------------------------------------
+
+
+// A chain such as from(3).filter(p).map<U>(f).take(n) on lazy_stream<>
+// allocates a node and a closure per stage and per element. fused_stream<>
+// composes the chained operators into a single step function instead: each
+// operator wraps the step function of the previous stage once, in one of
+// the stages of step_gen.h, when a run starts, and elements are then pulled
+// through every stage with no intermediate node.
+//
+// A fused_stream<> is a recipe: every materialization (head, get, to_list,
+// fold_left,...) starts a new run with fresh state, so the pipeline can be
+// shared and reused like any immutable stream. to_lazy_stream() turns a run
+// into an ordinary memoized lazy_stream<> when one is needed.
+//
+// T must be default constructible.
+
+
+#ifndef FUSED_STREAM_H
+#define FUSED_STREAM_H
+
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "lazy_stream.h"
+#include "step_gen.h"
+
+
+template <typename T>
+class fused_stream
+{
+	// Pulls the next element into its argument. Returns false at the end.
+	typedef std::function<bool (T&)> step_fn_type;
+
+	// Creates a step function with its own fresh state
+	typedef std::function<step_fn_type ()> source_type;
+
+	typedef std::function<bool (const T&)> predicate_fn_type;
+
+	template <typename U>
+	friend class fused_stream;
+
+	source_type source_;
+
+	explicit fused_stream(source_type&& source) :
+	source_(std::move(source)) {}
+
+	// Lazily pulls the rest of a run into a stream
+	static lazy_stream<T> pull(const std::shared_ptr<step_fn_type>& step_ptr);
+
+public:
+
+	// Creates the stream: {n, n+1, n+2,...}
+	static fused_stream<T> from(const T& n);
+
+	// Creates the stream: {n, n+step, n+2*step,...}
+	static fused_stream<T> from(const T& n, const T& step);
+
+	// Creates the stream: [from..to)
+	static fused_stream<T> range(const T& from, const T& to);
+
+	// Creates the stream: [from..to) with a step
+	static fused_stream<T> range(const T& from, const T& to, const T& step);
+
+	// Creates a pipeline pulling its elements from a lazy stream
+	explicit fused_stream(const lazy_stream<T>& stream);
+
+	// Is the stream empty?
+	bool empty() const;
+
+	// Gets the stream first element (head)
+	T head() const;
+
+	// Gets the element of index n [0..)
+	T get(size_t n) const;
+
+	// Gets the number of elements in the stream
+	size_t size() const;
+
+	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+	fused_stream<T> filter(const predicate_fn_type& filter_fn) const;
+
+	// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+	fused_stream<T> filter_not(const predicate_fn_type& filter_fn) const;
+
+	// Creates the substream of the first n elements
+	fused_stream<T> take(size_t n) const;
+
+	// Creates the substream resulting from dropping the first n elements
+	fused_stream<T> drop(size_t n) const;
+
+	// Creates the substream whose head does not comply with drop_fn predicate
+	fused_stream<T> drop_while(const predicate_fn_type& drop_fn) const;
+
+	// Creates a stream by applying the map_fn map
+	template <typename U>
+	fused_stream<U> map(const std::function<U (const T&)>& map_fn) const;
+
+	// Fold left reduction
+	template <typename U>
+	std::function<U (const std::function<U (const U&, const T&)>&)> fold_left(const U& start) const;
+
+	// Pours the stream into a std::list
+	std::list<T> to_list() const;
+
+	// Runs the pipeline as a lazy stream, pulling each element on demand
+	lazy_stream<T> to_lazy_stream() const;
+};
+
+
+// Creates the stream: {n, n+1, n+2,...}
+template <typename T>
+fused_stream<T> fused_stream<T>::from(const T& n)
+{
+	return from(n, T(1));
+}
+
+
+// Creates the stream: {n, n+step, n+2*step,...}
+template <typename T>
+fused_stream<T> fused_stream<T>::from(const T& n, const T& step)
+{
+	return fused_stream<T>([n, step]() -> step_fn_type {
+		return step_gen_detail::from_gen<T>{n, step};
+		});
+}
+
+
+// Creates the stream: [from..to)
+template <typename T>
+fused_stream<T> fused_stream<T>::range(const T& from, const T& to)
+{
+	return range(from, to, to<from ? T(-1) : T(1));
+}
+
+
+// Creates the stream: [from..to) with a step
+template <typename T>
+fused_stream<T> fused_stream<T>::range(const T& from, const T& to, const T& step)
+{
+	return fused_stream<T>([from, to, step]() -> step_fn_type {
+		return step_gen_detail::range_gen<T>{from, to, step};
+		});
+}
+
+
+// Creates a pipeline pulling its elements from a lazy stream
+template <typename T>
+fused_stream<T>::fused_stream(const lazy_stream<T>& stream) :
+source_([stream]() -> step_fn_type {
+	return step_gen_detail::lazy_gen<T>{stream};
+	}) {}
+
+
+// Is the stream empty?
+template <typename T>
+bool fused_stream<T>::empty() const
+{
+	T value;
+
+	return !source_()(value);
+}
+
+
+// Gets the stream first element (head)
+template <typename T>
+T fused_stream<T>::head() const
+{
+	T value;
+
+	if(!source_()(value))
+		throw std::range_error("Class: fused_stream<>. No head in empty stream.");
+
+	return value;
+}
+
+
+// Gets the element of index n [0..)
+template <typename T>
+T fused_stream<T>::get(size_t n) const
+{
+	step_fn_type step=source_();
+	T value;
+
+	for(size_t i=0; i<=n; ++i)
+		if(!step(value))
+			throw std::range_error("Class: fused_stream<>. Index out of range.");
+
+	return value;
+}
+
+
+// Gets the number of elements in the stream
+template <typename T>
+size_t fused_stream<T>::size() const
+{
+	step_fn_type step=source_();
+	size_t accu=0;
+	T value;
+
+	while(step(value))
+		++accu;
+
+	return accu;
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+template <typename T>
+fused_stream<T> fused_stream<T>::filter(const predicate_fn_type& filter_fn) const
+{
+	source_type source=source_;
+
+	return fused_stream<T>([source, filter_fn]() -> step_fn_type {
+		return step_gen_detail::filter_gen<step_fn_type, predicate_fn_type, T>{source(), filter_fn};
+		});
+}
+
+
+// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+template <typename T>
+fused_stream<T> fused_stream<T>::filter_not(const predicate_fn_type& filter_fn) const
+{
+	return filter([filter_fn](const T& value){return !filter_fn(value);});
+}
+
+
+// Creates the substream of the first n elements
+template <typename T>
+fused_stream<T> fused_stream<T>::take(size_t n) const
+{
+	source_type source=source_;
+
+	return fused_stream<T>([source, n]() -> step_fn_type {
+		return step_gen_detail::take_gen<step_fn_type, T>{source(), n};
+		});
+}
+
+
+// Creates the substream resulting from dropping the first n elements
+template <typename T>
+fused_stream<T> fused_stream<T>::drop(size_t n) const
+{
+	source_type source=source_;
+
+	return fused_stream<T>([source, n]() -> step_fn_type {
+		return step_gen_detail::drop_gen<step_fn_type, T>{source(), n};
+		});
+}
+
+
+// Creates the substream whose head does not comply with drop_fn predicate
+template <typename T>
+fused_stream<T> fused_stream<T>::drop_while(const predicate_fn_type& drop_fn) const
+{
+	source_type source=source_;
+
+	return fused_stream<T>([source, drop_fn]() -> step_fn_type {
+		return step_gen_detail::drop_while_gen<step_fn_type, predicate_fn_type, T>{source(), drop_fn, true};
+		});
+}
+
+
+// Creates a stream by applying the map_fn map
+template <typename T>
+template <typename U>
+fused_stream<U> fused_stream<T>::map(const std::function<U (const T&)>& map_fn) const
+{
+	source_type source=source_;
+
+	return fused_stream<U>([source, map_fn]() -> std::function<bool (U&)> {
+		return step_gen_detail::map_gen<step_fn_type, std::function<U (const T&)>, T, U>{source(), map_fn, T()};
+		});
+}
+
+
+// Fold left reduction
+//
+// Same sequence as lazy_stream<>::fold_left.
+//
+template <typename T>
+template <typename U>
+std::function<U (const std::function<U (const U&, const T&)>&)> fused_stream<T>::fold_left(const U& start) const
+{
+	source_type source=source_;
+
+	return [source, start](const std::function<U (const U&, const T&)>& fold_fn) -> U {
+		step_fn_type step=source();
+		U accu=start;
+		T value;
+
+		while(step(value))
+			accu=fold_fn(accu, value);
+
+		return accu;
+		};
+}
+
+
+// Pours the stream into a std::list
+template <typename T>
+std::list<T> fused_stream<T>::to_list() const
+{
+	step_fn_type step=source_();
+	std::list<T> accu;
+	T value;
+
+	while(step(value))
+		accu.push_back(value);
+
+	return accu;
+}
+
+
+// Runs the pipeline as a lazy stream, pulling each element on demand
+//
+// The run state is shared by the nodes of the resulting stream. Since
+// lazy_stream<> memoizes its tails, each element is pulled exactly once.
+//
+template <typename T>
+lazy_stream<T> fused_stream<T>::to_lazy_stream() const
+{
+	return pull(std::make_shared<step_fn_type>(source_()));
+}
+
+
+// Lazily pulls the rest of a run into a stream
+template <typename T>
+lazy_stream<T> fused_stream<T>::pull(const std::shared_ptr<step_fn_type>& step_ptr)
+{
+	T value;
+
+	if(!(*step_ptr)(value))
+		return lazy_stream<T>();
+
+	return lazy_stream<T>(std::move(value), [step_ptr]() -> lazy_stream<T> {
+		return fused_stream<T>::pull(step_ptr);
+		});
+}
+
+
+#endif
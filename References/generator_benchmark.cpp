@@ -0,0 +1,177 @@
+// ---------------------------------------------------------
+// - File: generator_benchmark                             -
+// - Coroutine generator<> sources against closure chains  -
+// - (C++20)                                               -
+// ---------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "benchmark_timer.h"
+#include "generator_stream.h"
+#include "lazy_stream.h"
+
+
+// Times both sources, which must agree, and prints ns per element.
+template <typename U>
+void report(const char* name, long n, const std::function<U ()>& closure_fn, const std::function<U ()>& coroutine_fn)
+{
+	U closure_result=U();
+	U coroutine_result=U();
+
+	double closure_ms=time_ms([&](){closure_result=closure_fn();});
+	double coroutine_ms=time_ms([&](){coroutine_result=coroutine_fn();});
+
+	if(closure_result!=coroutine_result)
+		throw std::logic_error("Closure chain and coroutine disagree.");
+
+	std::cout << std::setw(10) << name << "(" << std::setw(7) << n << "): closure chain "
+				<< std::setw(9) << closure_ms << "ms (" << std::setw(8) << 1e6*closure_ms/n
+				<< "ns/elem), coroutine " << std::setw(9) << coroutine_ms << "ms ("
+				<< std::setw(8) << 1e6*coroutine_ms/n << "ns/elem)" << std::endl;
+}
+
+
+//
+// from: {n, n+1, n+2,...}
+//
+
+lazy_stream<long> closure_from(long n)
+{
+	return lazy_stream<long>(n, [n](){return closure_from(n+1);});
+}
+
+
+generator<long> coroutine_from(long n)
+{
+	for(;; ++n)
+		co_yield n;
+}
+
+
+//
+// The sieve of sample.cpp: every candidate is tried against the primes
+// found so far, in order, until one divides it.
+//
+
+lazy_stream<long> closure_sieve(const lazy_stream<long>& start)
+{
+	long head=start.head();
+	lazy_stream<long> temp=start.filter([head](const long& value){return value%head>0;});
+
+	return lazy_stream<long>(head, [temp](){return closure_sieve(temp);});
+}
+
+
+generator<long> coroutine_sieve()
+{
+	std::vector<long> primes;
+
+	for(long candidate=2;; ++candidate)
+	{
+		bool prime=true;
+
+		for(long divisor : primes)
+			if(candidate%divisor==0)
+			{
+				prime=false;
+				break;
+			}
+
+		if(prime)
+		{
+			primes.push_back(candidate);
+			co_yield candidate;
+		}
+	}
+}
+
+
+//
+// Tokenizer: the whitespace-separated words of a file.
+//
+
+lazy_stream<std::string> closure_tokens(const std::shared_ptr<std::ifstream>& in)
+{
+	std::string word;
+
+	if(!(*in >> word))
+		return lazy_stream<std::string>();
+
+	return lazy_stream<std::string>(std::move(word), [in](){return closure_tokens(in);});
+}
+
+
+generator<std::string> coroutine_tokens(std::string path)
+{
+	std::ifstream in(path);
+	std::string word;
+
+	while(in >> word)
+		co_yield word;
+}
+
+
+// Sums the first n elements of stream, consuming it.
+long sum_first(lazy_stream<long>&& stream, long n)
+{
+	return std::move(stream).take(n).fold_left_consume<long>(0,
+		[](const long& accu, const long& value){return accu+value;});
+}
+
+
+// Total length of the words of stream, consuming it.
+long total_length(lazy_stream<std::string>&& stream)
+{
+	return std::move(stream).fold_left_consume<long>(0,
+		[](const long& accu, const std::string& word){return accu+long(word.size());});
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 1000000;
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	report<long>("from", n,
+		[n](){return sum_first(closure_from(0), n);},
+		[n](){return sum_first(coroutine_from(0).to_lazy_stream(), n);});
+
+	long primes=n/500;
+
+	report<long>("sieve", primes,
+		[primes](){return sum_first(closure_sieve(closure_from(2)), primes);},
+		[primes](){return sum_first(coroutine_sieve().to_lazy_stream(), primes);});
+
+	// A file of n words of 1 to 8 letters
+	std::string path="generator_benchmark.txt";
+	{
+		std::ofstream out(path);
+		unsigned long seed=1;
+
+		for(long i=0; i<n; ++i)
+		{
+			seed=seed*6364136223846793005UL+1442695040888963407UL;
+			out << std::string(1+(seed>>61), char('a'+(seed>>40)%26)) << (i%16==15 ? '\n' : ' ');
+		}
+	}
+
+	report<long>("tokenizer", n,
+		[&path](){return total_length(closure_tokens(std::make_shared<std::ifstream>(path)));},
+		[&path](){return total_length(coroutine_tokens(path).to_lazy_stream());});
+
+	std::remove(path.c_str());
+
+	return 0;
+}
+
+// compile this> g++ -std=c++20 -O2 -pthread generator_benchmark.cpp -o generator_benchmark
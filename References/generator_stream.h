@@ -0,0 +1,172 @@
+// ---------------------------------------------------------
+// - Class: generator<>                                    -
+// - Coroutine source for lazy_stream<> (C++20)            -
+// ---------------------------------------------------------
+
+
+// A generator<T> is the return type of a coroutine that co_yields the
+// elements of a stream:
+//
+// generator<long> squares()
+// {
+// 	for(long i=0;; ++i)
+// 		co_yield i*i;
+// }
+//
+// lazy_stream<long> stream=squares().to_lazy_stream();
+//
+// All the state of the generator lives in its coroutine frame, instead of
+// being copied into a new closure at every step. The stream resumes the
+// coroutine once per element, when the tail of the previous one is first
+// forced, so the elements stay memoized and every lazy_stream<> operator
+// applies. An exception escaping the coroutine is rethrown by every later
+// attempt to force that tail.
+//
+// Every node of the stream shares the ownership of the coroutine frame
+// through its head, which is released with the last node.
+
+
+#ifndef GENERATOR_STREAM_H
+#define GENERATOR_STREAM_H
+
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "lazy_stream.h"
+
+
+template <typename T>
+class generator
+{
+public:
+
+	struct promise_type
+	{
+		const T* value_;				// Last yielded value, alive while suspended
+		std::exception_ptr error_;
+
+		generator get_return_object()
+		{
+			return generator(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept {return {};}
+
+		std::suspend_always final_suspend() noexcept {return {};}
+
+		std::suspend_always yield_value(const T& value) noexcept
+		{
+			value_=std::addressof(value);
+			return {};
+		}
+
+		void return_void() noexcept {}
+
+		void unhandled_exception() {error_=std::current_exception();}
+	};
+
+	typedef std::coroutine_handle<promise_type> handle_type;
+
+private:
+
+	// Coroutine frame shared by the nodes of the stream it feeds
+	struct state_type : std::enable_shared_from_this<state_type>
+	{
+		handle_type handle_;
+
+		explicit state_type(handle_type handle) :
+		handle_(handle) {}
+
+		~state_type() {handle_.destroy();}
+	};
+
+	// Node head keeping the coroutine frame alive
+	struct node_head_type
+	{
+		T value_;
+		std::shared_ptr<state_type> state_ptr_;
+	};
+
+	handle_type handle_;
+
+	explicit generator(handle_type handle) :
+	handle_(handle) {}
+
+	// Resumes the coroutine for the next element of the stream (private)
+	static lazy_stream<T> pull(state_type* state);
+
+public:
+
+	generator(generator&& other) noexcept :
+	handle_(std::exchange(other.handle_, nullptr)) {}
+
+	generator(const generator&)=delete;
+	generator& operator=(const generator&)=delete;
+
+	// Destroys the coroutine frame, unless a stream owns it
+	~generator()
+	{
+		if(handle_)
+			handle_.destroy();
+	}
+
+	// Runs the coroutine as a lazy stream, pulling each element on demand
+	lazy_stream<T> to_lazy_stream() &&;
+
+	// Explicit conversion to a lazy stream
+	explicit operator lazy_stream<T>() && {return std::move(*this).to_lazy_stream();}
+};
+
+
+// Runs the coroutine as a lazy stream, pulling each element on demand
+//
+// The generator hands its coroutine over to the stream, so this may only be
+// called once.
+//
+template <typename T>
+lazy_stream<T> generator<T>::to_lazy_stream() &&
+{
+	if(!handle_)
+		throw std::logic_error("Class: generator<>. Coroutine already handed over to a stream.");
+
+	std::shared_ptr<state_type> state_ptr=std::make_shared<state_type>(std::exchange(handle_, nullptr));
+
+	return pull(state_ptr.get());
+}
+
+
+// Resumes the coroutine for the next element of the stream (private)
+//
+// The tail generator only captures the frame pointer, small enough for
+// std::function to hold it without a heap allocation: the node forcing it
+// keeps the frame alive through its head. Tails are forced in stream order,
+// one at a time, so the coroutine is never resumed concurrently.
+//
+template <typename T>
+lazy_stream<T> generator<T>::pull(state_type* state)
+{
+	handle_type handle=state->handle_;
+
+	if(!handle.done())
+		handle.resume();
+
+	if(handle.promise().error_)
+		std::rethrow_exception(handle.promise().error_);
+
+	if(handle.done())
+		return lazy_stream<T>();
+
+	std::shared_ptr<node_head_type> head_ptr=std::allocate_shared<node_head_type>(
+		stream_allocator<node_head_type>(),
+		node_head_type{*handle.promise().value_, state->shared_from_this()});
+
+	return lazy_stream<T>::from_shared(std::shared_ptr<T>(head_ptr, &head_ptr->value_), [state]() {
+		return pull(state);
+		});
+}
+
+
+#endif
@@ -0,0 +1,127 @@
+// ---------------------------------------------------------
+// - File: group_benchmark                                 -
+// - Hash aggregation and join of lazy_stream<> against    -
+// - std::unordered_map, in memory and spilled to disk     -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "benchmark_timer.h"
+#include "grouped_stream.h"
+
+
+// n pseudo-random values. The temporary range dies here, so that nothing
+// retains the nodes already read.
+lazy_stream<long> scrambled(long n)
+{
+	return lazy_stream<long>::range(0, n).map<long>([](const long& index){return (index*2654435761L+12345)&0x7fffffff;});
+}
+
+
+// An order, as joined by its customer
+struct order
+{
+	long customer_;
+	long amount_;
+};
+
+
+// n orders of customers in [0..customers)
+lazy_stream<order> orders(long n, long customers)
+{
+	return scrambled(n).map<order>([customers](const long& value){return order{value%customers, value&1023};});
+}
+
+
+std::function<long (const long&)> key=[](const long& value){return value%1000003;};
+std::function<long (const long&, const long&)> sum=[](const long& accu, const long& value){return accu+value;};
+
+
+// Aggregates n values into a sum per key, through group_by with budget.
+long group_by_checksum(long n, size_t budget)
+{
+	long checksum=0;
+
+	group_by<long, long>(scrambled(n), key, 0L, sum, budget)
+		.for_each_consume([&checksum](const std::pair<long, long>& group){checksum+=group.first^group.second;});
+
+	return checksum;
+}
+
+
+// The same through to_list and std::unordered_map.
+long unordered_map_checksum(long n)
+{
+	std::unordered_map<long, long> groups;
+	long checksum=0;
+
+	for(const long& value : scrambled(n).to_list())
+		groups[key(value)]+=value;
+
+	for(const std::pair<const long, long>& group : groups)
+		checksum+=group.first^group.second;
+
+	return checksum;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 4000000;
+	size_t spill_budget=size_t(4)<<20;
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << n << " elements, about 1000003 keys" << std::endl;
+
+	long expected=0;
+	long checksum=0;
+
+	double map_ms=time_ms([&](){expected=unordered_map_checksum(n);});
+	double group_ms=time_ms([&](){checksum=group_by_checksum(n, grouped_stream_detail::default_budget);});
+
+	if(checksum!=expected)
+		throw std::logic_error("Unexpected groups.");
+
+	double spilled_ms=time_ms([&](){checksum=group_by_checksum(n, spill_budget);});
+
+	if(checksum!=expected)
+		throw std::logic_error("Unexpected spilled groups.");
+
+	std::cout << "to_list+unordered_map: " << std::setw(8) << map_ms << "ms" << std::endl;
+	std::cout << "group_by:              " << std::setw(8) << group_ms << "ms" << std::endl;
+	std::cout << "group_by, " << (spill_budget>>20) << "MiB budget: " << std::setw(8) << spilled_ms << "ms" << std::endl;
+
+	// Joins n orders to the 16 times fewer customers
+	long customers=n/16;
+	std::function<long (const long&)> customer_key=[](const long& customer){return customer;};
+	std::function<long (const order&)> order_key=[](const order& row){return row.customer_;};
+
+	for(size_t budget : {grouped_stream_detail::default_budget, spill_budget})
+	{
+		long amount=0;
+		double join_ms=time_ms([&](){
+			hash_join<long>(lazy_stream<long>::range(0, customers), orders(n, customers), customer_key, order_key,
+				budget).for_each_consume([&amount](const std::pair<long, order>& row){amount+=row.second.amount_;});
+			});
+
+		long expected_amount=orders(n, customers).fold_left_consume<long>(0L,
+			[](const long& accu, const order& row){return accu+row.amount_;});
+
+		if(amount!=expected_amount)
+			throw std::logic_error("Unexpected join.");
+
+		std::cout << "hash_join, " << std::setw(2) << (budget>>20) << "MiB budget: " << std::setw(8) << join_ms << "ms"
+					<< std::endl;
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread group_benchmark.cpp -o group_benchmark
@@ -0,0 +1,565 @@
+// ---------------------------------------------------------
+// - Hash aggregation and joins of lazy_stream<>, spilling -
+// - to disk beyond a memory budget                        -
+// ---------------------------------------------------------
+
+
+// group_by folds the elements of a stream by key, count_by counts them,
+// and hash_join pairs the elements of two streams with equal keys. They
+// keep their keys in a hash_table, and once it holds more than a memory
+// budget, they deal the rest of their input out to temporary files by the
+// hash of its keys, one partition at a time coming back in memory as the
+// result reaches it: the result can exceed the memory available, as long
+// as a partition fits in the budget.
+//
+// Every function takes its source streams by value: pass them with
+// std::move, as in count_by<long>(std::move(stream), key_fn), so that their
+// nodes are released once read when no other copy of the streams is
+// alive.
+
+
+#ifndef GROUPED_STREAM_H
+#define GROUPED_STREAM_H
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "hash_table.h"
+#include "lazy_stream.h"
+#include "spill_file.h"
+
+
+namespace grouped_stream_detail
+{
+
+// Default memory budget of the hash tables, in bytes
+const size_t default_budget=size_t(64)<<20;
+
+// Partitions of the input once it spills to disk
+const size_t partition_count=64;
+
+// Makes a parameter a non-deduced context, its type given by the other arguments
+template <typename T>
+struct non_deduced
+{
+	typedef T type;
+};
+
+// Gets the spill partition of a key hash, independent of its slot in a hash_table
+inline size_t spill_partition(size_t hash)
+{
+	return hash_table_detail::mix_hash(hash, 0x9e3779b97f4a7c15ULL)%partition_count;
+}
+
+// Fixed-size records dealt to a set of spill files by partition, through write buffers
+class spill_partitions
+{
+	static const size_t buffer_size=size_t(1)<<15;
+
+	std::vector<std::shared_ptr<spill_file>> files_;	// Created with their first full buffer
+	std::vector<std::vector<unsigned char>> buffers_;
+
+	// Writes the buffer of partition to its file
+	void flush(size_t partition)
+	{
+		if(buffers_[partition].empty())
+			return;
+
+		if(!files_[partition])
+			files_[partition]=std::make_shared<spill_file>();
+
+		files_[partition]->write(buffers_[partition].data(), buffers_[partition].size());
+		buffers_[partition].clear();
+	}
+
+public:
+
+	spill_partitions() :
+	files_(partition_count),
+	buffers_(partition_count) {}
+
+	// Appends bytes bytes to the last record of partition
+	void append(size_t partition, const void* data, size_t bytes)
+	{
+		const unsigned char* first=static_cast<const unsigned char*>(data);
+
+		buffers_[partition].insert(buffers_[partition].end(), first, first+bytes);
+
+		if(buffers_[partition].size()>=buffer_size)
+			flush(partition);
+	}
+
+	// Gets the file of partition, rewound for reading, or nullptr if it got no record
+	std::shared_ptr<spill_file> finish(size_t partition)
+	{
+		flush(partition);
+
+		std::shared_ptr<spill_file> accu=std::move(files_[partition]);
+
+		if(accu)
+			accu->rewind();
+
+		return accu;
+	}
+};
+
+// Reads back the fixed-size records of a spill file, one block at a time
+class spill_reader
+{
+	std::shared_ptr<spill_file> file_ptr_;		// Released at the end of the file
+	std::vector<unsigned char> block_;
+	size_t record_size_;
+	size_t next_;
+	size_t size_;
+
+public:
+
+	spill_reader(std::shared_ptr<spill_file> file_ptr, size_t record_size) :
+	file_ptr_(std::move(file_ptr)),
+	block_(record_size*std::max(size_t(1), (size_t(1)<<16)/record_size)),
+	record_size_(record_size),
+	next_(0),
+	size_(0) {}
+
+	// Gets the next record, or nullptr at the end
+	const unsigned char* next()
+	{
+		if(next_>=size_)
+		{
+			size_=file_ptr_ ? file_ptr_->read(block_.data(), block_.size()) : 0;
+			next_=0;
+
+			if(size_<record_size_)
+			{
+				file_ptr_.reset();
+				return nullptr;
+			}
+		}
+
+		const unsigned char* accu=&block_[next_];
+
+		next_+=record_size_;
+		return accu;
+	}
+};
+
+// A trivially copyable value read back from the bytes of a record
+template <typename V>
+struct raw_slot
+{
+	alignas(V) unsigned char bytes_[sizeof(V)];
+
+	explicit raw_slot(const unsigned char* data) {std::memcpy(bytes_, data, sizeof(V));}
+
+	const V& get() const {return *reinterpret_cast<const V*>(bytes_);}
+};
+
+// Streams the elements spilled to a file
+template <typename T>
+lazy_stream<T> spill_pull(const std::shared_ptr<spill_reader>& reader_ptr)
+{
+	const unsigned char* record=reader_ptr->next();
+
+	if(!record)
+		return lazy_stream<T>();
+
+	return lazy_stream<T>(raw_slot<T>(record).get(), [reader_ptr]() {
+		return spill_pull<T>(reader_ptr);
+		});
+}
+
+// Groups of group_by, and the partitions left to aggregate once spilled to disk
+template <typename T, typename Key, typename U>
+struct group_state
+{
+	std::function<Key (const T&)> key_fn_;
+	U start_;
+	std::function<U (const U&, const T&)> agg_fn_;
+	std::vector<std::shared_ptr<spill_file>> partials_;	// Key and fold records
+	std::vector<std::shared_ptr<spill_file>> elements_;	// Element records
+	size_t next_;											// Next partition to aggregate
+
+	group_state(const std::function<Key (const T&)>& key_fn, const U& start,
+		const std::function<U (const U&, const T&)>& agg_fn) :
+	key_fn_(key_fn),
+	start_(start),
+	agg_fn_(agg_fn),
+	next_(0) {}
+};
+
+// Aggregates the next spilled partition holding a group
+//
+// The folds spilled with the table come first, then go on with the
+// elements spilled after them, in stream order.
+//
+template <typename T, typename Key, typename U>
+std::vector<std::pair<Key, U>> group_partition(group_state<T, Key, U>& state)
+{
+	while(state.next_<state.elements_.size())
+	{
+		size_t partition=state.next_++;
+		hash_table<Key, U> table;
+		bool inserted;
+
+		spill_reader partials(std::move(state.partials_[partition]), sizeof(Key)+sizeof(U));
+
+		while(const unsigned char* record=partials.next())
+			table.insert(raw_slot<Key>(record).get(), raw_slot<U>(record+sizeof(Key)).get(), inserted);
+
+		spill_reader elements(std::move(state.elements_[partition]), sizeof(T));
+
+		while(const unsigned char* record=elements.next())
+		{
+			raw_slot<T> value(record);
+			U& accu=table.insert(state.key_fn_(value.get()), state.start_, inserted);
+
+			accu=state.agg_fn_(accu, value.get());
+		}
+
+		if(table.size()>0)
+			return table.release();
+	}
+
+	return std::vector<std::pair<Key, U>>();
+}
+
+// Streams the groups from index on, then those of the partitions left
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<Key, U>> group_pull(std::shared_ptr<std::vector<std::pair<Key, U>>> groups_ptr, size_t index,
+	const std::shared_ptr<group_state<T, Key, U>>& state_ptr)
+{
+	while(index>=groups_ptr->size())
+	{
+		if(state_ptr->next_>=state_ptr->elements_.size())
+			return lazy_stream<std::pair<Key, U>>();
+
+		groups_ptr=std::make_shared<std::vector<std::pair<Key, U>>>(group_partition(*state_ptr));
+		index=0;
+	}
+
+	return lazy_stream<std::pair<Key, U>>::from_shared(
+		std::shared_ptr<std::pair<Key, U>>(groups_ptr, &(*groups_ptr)[index]),
+		[groups_ptr, index, state_ptr]() {
+			return group_pull(groups_ptr, index+1, state_ptr);
+			});
+}
+
+// Aggregates the elements of source by key, spilling partitions to disk if needed
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<Key, U>> group_from(lazy_stream<T> source, const std::function<Key (const T&)>& key_fn,
+	const U& start, const std::function<U (const U&, const T&)>& agg_fn, size_t memory_budget)
+{
+	std::shared_ptr<group_state<T, Key, U>> state_ptr=std::make_shared<group_state<T, Key, U>>(key_fn, start, agg_fn);
+	hash_table<Key, U> table;
+	std::unique_ptr<spill_partitions> partials;
+	std::unique_ptr<spill_partitions> elements;
+
+	for(const T& value : std::move(source).consume())
+	{
+		Key key=key_fn(value);
+
+		if(elements)
+		{
+			elements->append(spill_partition(std::hash<Key>()(key)), &value, sizeof(T));
+			continue;
+		}
+
+		bool inserted;
+		U& accu=table.insert(key, start, inserted);
+
+		accu=agg_fn(accu, value);
+
+		if(inserted && table.bytes()>memory_budget)
+		{
+			if(!std::is_trivially_copyable<T>::value || !std::is_trivially_copyable<Key>::value ||
+				!std::is_trivially_copyable<U>::value)
+				throw std::length_error("Function: group_by. Groups over the hash budget cannot be spilled to disk.");
+
+			partials.reset(new spill_partitions());
+			elements.reset(new spill_partitions());
+
+			for(size_t i=0; i<table.size(); ++i)
+			{
+				size_t partition=spill_partition(table.hash(i));
+
+				partials->append(partition, &table.entry(i).first, sizeof(Key));
+				partials->append(partition, &table.entry(i).second, sizeof(U));
+			}
+
+			table.release();
+		}
+	}
+
+	if(elements)
+	{
+		for(size_t i=0; i<partition_count; ++i)
+		{
+			state_ptr->partials_.push_back(partials->finish(i));
+			state_ptr->elements_.push_back(elements->finish(i));
+		}
+	}
+
+	return group_pull(std::make_shared<std::vector<std::pair<Key, U>>>(table.release()), 0, state_ptr);
+}
+
+// Elements of the other stream of hash_join, chained by key
+template <typename Key, typename U>
+struct join_table
+{
+	static const size_t npos=size_t(-1);
+
+	hash_table<Key, std::pair<size_t, size_t>> keys_;	// First and last rows of every key
+	std::vector<U> rows_;
+	std::vector<size_t> next_;						// Next row with the same key, or npos
+
+	// Adds row, whose key is key
+	void insert(const Key& key, const U& row)
+	{
+		bool inserted;
+		std::pair<size_t, size_t>& rows=keys_.insert(key, std::make_pair(rows_.size(), rows_.size()), inserted);
+
+		if(!inserted)
+		{
+			next_[rows.second]=rows_.size();
+			rows.second=rows_.size();
+		}
+
+		rows_.push_back(row);
+		next_.push_back(npos);
+	}
+
+	// Gets the memory held, in bytes
+	size_t bytes() const
+	{
+		return keys_.bytes()+rows_.capacity()*sizeof(U)+next_.capacity()*sizeof(size_t);
+	}
+};
+
+// No row
+template <typename Key, typename U>
+const size_t join_table<Key, U>::npos;
+
+// State of a hash_join probe, plus the partitions left to join once spilled to disk
+template <typename T, typename Key, typename U>
+struct join_state
+{
+	std::function<Key (const T&)> key_fn_;
+	std::function<Key (const U&)> other_key_fn_;
+	join_table<Key, U> table_;
+	std::vector<std::shared_ptr<spill_file>> left_;		// Records of the probed stream
+	std::vector<std::shared_ptr<spill_file>> right_;	// Records of the other stream
+	size_t next_;										// Next partition to join
+};
+
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<T, U>> join_partition(const std::shared_ptr<join_state<T, Key, U>>& state_ptr);
+
+// Streams the pairs from row on of the element at position, or of the next element with a match if row is npos
+//
+// Elements with no match are skipped in a loop. Tails are forced in order,
+// one at a time, so the state is never used concurrently.
+//
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<T, U>> join_probe(lazy_stream<T> position, size_t row,
+	const std::shared_ptr<join_state<T, Key, U>>& state_ptr)
+{
+	const size_t npos=join_table<Key, U>::npos;
+	const join_state<T, Key, U>& state=*state_ptr;
+
+	if(row==npos)
+	{
+		lazy_stream<T> match=std::move(position).drop_while([&state](const T& value) {
+			return !state.table_.keys_.find(state.key_fn_(value));
+			});
+
+		if(match.empty())
+			return join_partition(state_ptr);
+
+		size_t first=state.table_.keys_.find(state.key_fn_(match.head()))->first;
+
+		return join_probe(std::move(match), first, state_ptr);
+	}
+
+	size_t next=state.table_.next_[row];
+
+	return lazy_stream<std::pair<T, U>>(std::pair<T, U>(position.head(), state.table_.rows_[row]),
+		[position, next, state_ptr]() {
+			return next==npos ? join_probe(position.tail(), next, state_ptr) : join_probe(position, next, state_ptr);
+			});
+}
+
+// Loads the next spilled partition with elements on both sides into the table and probes it
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<T, U>> join_partition(const std::shared_ptr<join_state<T, Key, U>>& state_ptr)
+{
+	join_state<T, Key, U>& state=*state_ptr;
+
+	while(state.next_<state.left_.size())
+	{
+		size_t partition=state.next_++;
+		std::shared_ptr<spill_file> left_ptr=std::move(state.left_[partition]);
+		spill_reader right(std::move(state.right_[partition]), sizeof(U));
+
+		state.table_=join_table<Key, U>();
+
+		while(const unsigned char* record=right.next())
+		{
+			raw_slot<U> value(record);
+
+			state.table_.insert(state.other_key_fn_(value.get()), value.get());
+		}
+
+		if(left_ptr && state.table_.rows_.size()>0)
+			return join_probe(spill_pull<T>(std::make_shared<spill_reader>(std::move(left_ptr), sizeof(T))),
+				join_table<Key, U>::npos, state_ptr);
+	}
+
+	return lazy_stream<std::pair<T, U>>();
+}
+
+// Joins the elements of source with those of other, spilling partitions to disk if needed
+template <typename T, typename Key, typename U>
+lazy_stream<std::pair<T, U>> join_from(lazy_stream<T> source, lazy_stream<U> other,
+	const std::function<Key (const T&)>& key_fn, const std::function<Key (const U&)>& other_key_fn,
+	size_t memory_budget)
+{
+	const size_t npos=join_table<Key, U>::npos;
+	std::shared_ptr<join_state<T, Key, U>> state_ptr=std::make_shared<join_state<T, Key, U>>();
+	join_table<Key, U>& table=state_ptr->table_;
+	std::unique_ptr<spill_partitions> right;
+
+	state_ptr->key_fn_=key_fn;
+	state_ptr->other_key_fn_=other_key_fn;
+	state_ptr->next_=0;
+
+	for(const U& row : std::move(other).consume())
+	{
+		Key key=other_key_fn(row);
+
+		if(right)
+		{
+			right->append(spill_partition(std::hash<Key>()(key)), &row, sizeof(U));
+			continue;
+		}
+
+		table.insert(key, row);
+
+		if(table.bytes()>memory_budget)
+		{
+			if(!std::is_trivially_copyable<T>::value || !std::is_trivially_copyable<U>::value)
+				throw std::length_error("Function: hash_join. Join over the hash budget cannot be spilled to disk.");
+
+			right.reset(new spill_partitions());
+
+			for(size_t i=0; i<table.keys_.size(); ++i)
+			{
+				size_t partition=spill_partition(table.keys_.hash(i));
+
+				for(size_t j=table.keys_.entry(i).second.first; j!=npos; j=table.next_[j])
+					right->append(partition, &table.rows_[j], sizeof(U));
+			}
+
+			table=join_table<Key, U>();
+		}
+	}
+
+	if(!right)
+		return join_probe(std::move(source), npos, state_ptr);
+
+	spill_partitions left;
+
+	for(const T& value : std::move(source).consume())
+		left.append(spill_partition(std::hash<Key>()(key_fn(value))), &value, sizeof(T));
+
+	for(size_t i=0; i<partition_count; ++i)
+	{
+		state_ptr->left_.push_back(left.finish(i));
+		state_ptr->right_.push_back(right->finish(i));
+	}
+
+	return join_partition(state_ptr);
+}
+
+}	// namespace grouped_stream_detail
+
+
+// Creates the stream of every key and the fold of the elements of source with that key
+//
+// Every element is folded with agg_fn into the accumulator of its key,
+// which starts as start, in a single pass over source: the elements with
+// the same key are folded in stream order, as in fold_left. The groups
+// then come out lazily, in no particular order. Key must be supported by
+// std::hash and ==, and given explicitly, as in group_by<long>(...).
+// source must be finite.
+//
+// The accumulators live in a hash_table. Once it holds more than
+// memory_budget bytes, its groups are dealt out to partition_count
+// temporary files by the hash of their key, and so are the elements read
+// afterwards. Every partition is aggregated back in memory, its groups
+// resuming their fold, when the stream of groups reaches it: a partition
+// is expected to fit in the budget. Spilling writes raw bytes, so it needs
+// trivially copyable elements, keys and accumulators: for any other types
+// a table over the budget throws std::length_error.
+//
+template <typename Key, typename U, typename T>
+lazy_stream<std::pair<Key, U>> group_by(lazy_stream<T> source,
+	const typename grouped_stream_detail::non_deduced<std::function<Key (const T&)>>::type& key_fn,
+	const U& start,
+	const typename grouped_stream_detail::non_deduced<std::function<U (const U&, const T&)>>::type& agg_fn,
+	size_t memory_budget=grouped_stream_detail::default_budget)
+{
+	return grouped_stream_detail::group_from(std::move(source), key_fn, start, agg_fn, memory_budget);
+}
+
+
+// Creates the stream of every key and the number of elements of source with that key
+//
+// As group_by, counting the elements of every group.
+//
+template <typename Key, typename T>
+lazy_stream<std::pair<Key, size_t>> count_by(lazy_stream<T> source,
+	const typename grouped_stream_detail::non_deduced<std::function<Key (const T&)>>::type& key_fn,
+	size_t memory_budget=grouped_stream_detail::default_budget)
+{
+	std::function<size_t (const size_t&, const T&)> count=[](const size_t& accu, const T&){return accu+1;};
+
+	return grouped_stream_detail::group_from(std::move(source), key_fn, size_t(0), count, memory_budget);
+}
+
+
+// Creates the stream of the pairs of elements of source and other with equal keys
+//
+// other is read at once into a hash_table of its elements by key. source
+// is then probed lazily: the result holds, in the order of source, one
+// pair for every element of other with the same key, in their order. Key
+// must be supported by std::hash and ==, and given explicitly, as in
+// hash_join<long>(...). other must be finite.
+//
+// Once the table holds more than memory_budget bytes, the elements of
+// both streams are dealt out to partition_count temporary files by the
+// hash of their key, source being read at once too, and the partitions
+// are joined one at a time, as the result reaches them: the pairs then
+// come out partition by partition, and a partition of other is expected
+// to fit in the budget. Spilling writes raw bytes, so it needs trivially
+// copyable elements in both streams: for any other types a table over
+// the budget throws std::length_error.
+//
+template <typename Key, typename T, typename U>
+lazy_stream<std::pair<T, U>> hash_join(lazy_stream<T> source, lazy_stream<U> other,
+	const typename grouped_stream_detail::non_deduced<std::function<Key (const T&)>>::type& key_fn,
+	const typename grouped_stream_detail::non_deduced<std::function<Key (const U&)>>::type& other_key_fn,
+	size_t memory_budget=grouped_stream_detail::default_budget)
+{
+	return grouped_stream_detail::join_from(std::move(source), std::move(other), key_fn, other_key_fn, memory_budget);
+}
+
+
+#endif
@@ -0,0 +1,157 @@
+// ---------------------------------------------------------
+// - Class: hash_table<>                                   -
+// - Open-addressing hash table of the stream operators    -
+// ---------------------------------------------------------
+
+
+// hash_table keeps the accumulators of group_by and the rows of hash_join
+// by key, and the elements seen by distinct: denser and faster to fill
+// than std::unordered_map, whose nodes are allocated one by one. Its
+// entries come out in insertion order, and their memory is known, so a
+// table over a budget can be spilled to disk.
+
+
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+
+namespace hash_table_detail
+{
+
+// Mixes the bits of a hash, so that close keys spread over the slots and the partitions
+inline size_t mix_hash(size_t hash, uint64_t seed)
+{
+	uint64_t accu=uint64_t(hash)^seed;
+
+	accu^=accu>>33;
+	accu*=0xff51afd7ed558ccdULL;
+	accu^=accu>>33;
+	accu*=0xc4ceb9fe1a85ec53ULL;
+	accu^=accu>>33;
+
+	return size_t(accu);
+}
+
+}	// namespace hash_table_detail
+
+
+// Open-addressing hash table with linear probing
+//
+// The entries are stored densely, in insertion order, and the slots,
+// kept at most half full, index them. Key must be supported by std::hash
+// and ==.
+//
+template <typename Key, typename Value>
+class hash_table
+{
+	std::vector<std::pair<Key, Value>> entries_;
+	std::vector<size_t> hashes_;		// std::hash of the key of every entry
+	std::vector<size_t> slots_;			// Entry index+1, 0 if free
+
+	// Doubles the slots and indexes every entry again
+	void grow()
+	{
+		std::vector<size_t> slots(2*slots_.size(), 0);
+		size_t mask=slots.size()-1;
+
+		for(size_t i=0; i<hashes_.size(); ++i)
+		{
+			size_t slot=hash_table_detail::mix_hash(hashes_[i], 0)&mask;
+
+			while(slots[slot]!=0)
+				slot=(slot+1)&mask;
+
+			slots[slot]=i+1;
+		}
+
+		slots_.swap(slots);
+	}
+
+public:
+
+	hash_table() :
+	slots_(16, 0) {}
+
+	// Gets the value of key, inserting key with value first if it is absent
+	Value& insert(const Key& key, const Value& value, bool& inserted)
+	{
+		size_t hash=std::hash<Key>()(key);
+		size_t mask=slots_.size()-1;
+		size_t slot=hash_table_detail::mix_hash(hash, 0)&mask;
+
+		for(; slots_[slot]!=0; slot=(slot+1)&mask)
+		{
+			size_t i=slots_[slot]-1;
+
+			if(hashes_[i]==hash && entries_[i].first==key)
+			{
+				inserted=false;
+				return entries_[i].second;
+			}
+		}
+
+		entries_.emplace_back(key, value);
+		hashes_.push_back(hash);
+		slots_[slot]=entries_.size();
+		inserted=true;
+
+		if(2*entries_.size()>slots_.size())
+			grow();
+
+		return entries_.back().second;
+	}
+
+	// Gets the value of key, or nullptr if it is absent
+	const Value* find(const Key& key) const
+	{
+		size_t hash=std::hash<Key>()(key);
+		size_t mask=slots_.size()-1;
+
+		for(size_t slot=hash_table_detail::mix_hash(hash, 0)&mask; slots_[slot]!=0; slot=(slot+1)&mask)
+		{
+			size_t i=slots_[slot]-1;
+
+			if(hashes_[i]==hash && entries_[i].first==key)
+				return &entries_[i].second;
+		}
+
+		return nullptr;
+	}
+
+	// Gets the number of entries
+	size_t size() const {return entries_.size();}
+
+	// Gets entry i, in insertion order
+	const std::pair<Key, Value>& entry(size_t i) const {return entries_[i];}
+
+	// Gets the std::hash of the key of entry i
+	size_t hash(size_t i) const {return hashes_[i];}
+
+	// Gets the memory held, in bytes
+	size_t bytes() const
+	{
+		return entries_.capacity()*sizeof(std::pair<Key, Value>)+
+				(hashes_.capacity()+slots_.size())*sizeof(size_t);
+	}
+
+	// Takes the entries out, in insertion order, leaving the table empty
+	std::vector<std::pair<Key, Value>> release()
+	{
+		std::vector<std::pair<Key, Value>> accu;
+
+		accu.swap(entries_);
+		hashes_=std::vector<size_t>();
+		slots_.assign(16, 0);
+		return accu;
+	}
+};
+
+
+#endif
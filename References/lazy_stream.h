@@ -20,13 +20,131 @@
 #define LAZY_STREAM_H
 
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <future>
+#include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
+#include "stream_arena.h"
+
+
+template <typename T>
+class chunked_stream;
+
+
+namespace step_gen_detail
+{
+	template <typename T>
+	struct lazy_gen;
+}
+
+
+namespace lazy_stream_detail
+{
+	// Index arithmetic of the closed-form sequences of integral types
+	//
+	// Computed in uintmax_t and truncated back, so it wraps instead of
+	// overflowing. Other types have no closed form.
+	template <typename T, bool Integral=std::is_integral<T>::value && !std::is_same<T, bool>::value>
+	struct arithmetic_traits
+	{
+		static const bool enabled=false;
+
+		static bool closed(const T&) {return false;}
+		static bool ahead(const T&, const T&, const T&) {return false;}
+		static uintmax_t span(const T&, const T&, const T&) {return 0;}
+		static uintmax_t stride(const T&) {return 1;}
+		static const T& advance(const T& from, uintmax_t, const T&) {return from;}
+	};
+
+	template <typename T>
+	struct arithmetic_traits<T, true>
+	{
+		typedef typename std::make_unsigned<T>::type unsigned_type;
+
+		static const bool enabled=true;
+
+		// Does step give a closed-form sequence?
+		static bool closed(const T& step)
+		{
+			return step!=T(0);
+		}
+
+		// Is b reached from a going in the direction of step?
+		static bool ahead(const T& a, const T& b, const T& step)
+		{
+			return step>T(0) ? !(b<a) : !(a<b);
+		}
+
+		// Gets the distance from a to b in the direction of step
+		static uintmax_t span(const T& a, const T& b, const T& step)
+		{
+			return step>T(0) ?
+				uintmax_t(unsigned_type(unsigned_type(b)-unsigned_type(a))) :
+				uintmax_t(unsigned_type(unsigned_type(a)-unsigned_type(b)));
+		}
+
+		// Gets the absolute value of step
+		static uintmax_t stride(const T& step)
+		{
+			return step>T(0) ?
+				uintmax_t(unsigned_type(step)) :
+				uintmax_t(unsigned_type(unsigned_type(0)-unsigned_type(step)));
+		}
+
+		// Gets from+i*step
+		static T advance(const T& from, uintmax_t i, const T& step)
+		{
+			return T(unsigned_type(uintmax_t(unsigned_type(from))+i*uintmax_t(unsigned_type(step))));
+		}
+	};
+
+	// Tail cell under evaluation by a thread, linked to the one it was forced from
+	struct evaluation_frame
+	{
+		const void* cell_;
+		evaluation_frame* next_;
+	};
+
+	// Gets the innermost tail cell under evaluation by this thread
+	inline evaluation_frame*& evaluation_stack()
+	{
+		static thread_local evaluation_frame* top=nullptr;
+
+		return top;
+	}
+
+	// Hash of the elements of the types std::hash supports. Other types
+	// are only partitioned by key.
+	template <typename T, typename=void>
+	struct hash_traits
+	{
+		static const bool enabled=false;
+
+		static size_t hash(const T&) {return 0;}
+	};
+
+	template <typename T>
+	struct hash_traits<T, decltype(void(std::hash<T>()(std::declval<const T&>())))>
+	{
+		static const bool enabled=true;
+
+		static size_t hash(const T& value) {return std::hash<T>()(value);}
+	};
+}
 
 
 template <typename T>
@@ -39,16 +157,73 @@ class lazy_stream
 	typedef std::shared_ptr<tail_type> tail_ptr_type;
 
 	typedef std::function<lazy_stream<T> ()> tail_gen_type;
-	typedef std::shared_ptr<tail_gen_type> tail_gen_ptr_type;
+
+	// Tail cell shared by every copy of a stream node. It holds the tail
+	// generator until the tail is forced for the first time; from then on it
+	// holds the memoized tail and the generator is released.
+	//
+	// state_ makes the forcing once-only across threads:
+	// unevaluated -> evaluating [-> evaluating_waited] -> ready, or back to
+	// unevaluated if the generator throws.
+	//
+	// arena_ is the arena current when the node was created, allocated along
+	// with the cell: the tail is forced into it, not into the arena current
+	// at forcing time, which may not outlive the node.
+	struct tail_cell_type
+	{
+		enum {unevaluated, evaluating, evaluating_waited, ready};
+
+		std::atomic<int> state_;
+		tail_gen_type tail_gen_;
+		tail_ptr_type tail_ptr_;
+		stream_arena* arena_;	// Null for the heap
+
+		template <typename U>
+		explicit tail_cell_type(U&& tail_gen) :
+		state_(unevaluated),
+		tail_gen_(std::forward<U>(tail_gen)),
+		tail_ptr_(nullptr),
+		arena_(stream_arena::current()) {}
+	};
+
+	// Threads waiting for a tail under evaluation park on the stripe of its cell
+	struct parking_stripe_type
+	{
+		std::mutex mutex_;
+		std::condition_variable ready_;
+	};
+
+	typedef std::shared_ptr<tail_cell_type> tail_cell_ptr_type;
 
 	typedef std::function<bool (const T&)> predicate_fn_type;
 
+	typedef lazy_stream_detail::arithmetic_traits<T> arithmetic_traits;
+
+	// Closed form of an arithmetic sequence built by from or range: its
+	// elements are the head, head+step_, head+2*step_,... up to last_ unless
+	// it is infinite_. Every node of the sequence shares it.
+	struct arithmetic_type
+	{
+		T step_;
+		T last_;
+		bool infinite_;
+	};
+
+	typedef std::shared_ptr<const arithmetic_type> arithmetic_ptr_type;
+
 	template <typename U>
 	friend class lazy_stream;
 
+	template <typename U>
+	friend class chunked_stream;
+
+	template <typename U>
+	friend struct step_gen_detail::lazy_gen;
+
 	head_ptr_type head_ptr_;			// Head pointer
 	tail_ptr_type tail_ptr_;			// Tail pointer
-	tail_gen_ptr_type tail_gen_ptr_;	// Tail generator pointer
+	tail_cell_ptr_type tail_cell_ptr_;	// Shared tail cell pointer
+	arithmetic_ptr_type arithmetic_ptr_;	// Closed form, if from or range built this node
 	bool empty_;
 
 	// Assignment operator (private)
@@ -59,6 +234,27 @@ class lazy_stream
 
 public:
 
+	// Order in which parallel_fold and parallel_reduce combine partial results
+	enum parallel_order
+	{
+		ordered,	// Chunk partials are combined in stream order
+		unordered	// Chunk partials are combined as they are produced
+	};
+
+	// How partition deals the elements out to its substreams
+	enum partition_policy
+	{
+		round_robin,	// Chunks go to each substream in turn
+		hashed,			// Elements go to the substream their hash selects
+		contiguous		// Each substream is a range of consecutive elements
+	};
+
+	// Default number of elements per chunk in parallel_fold and parallel_reduce
+	static const size_t default_parallel_chunk=4096;
+
+	// Result of get: a value for integral types, whose sequences may compute it, a reference otherwise
+	typedef typename std::conditional<arithmetic_traits::enabled, T, const T&>::type get_type;
+
 	// Empty stream
 	static lazy_stream<T> nil;
 
@@ -74,11 +270,20 @@ public:
 	// Creates the stream: [from..to) with a step
 	static lazy_stream<T> range(const T& from, const T& to, const T& step);
 
+	// Creates a stream whose head is shared with head_ptr, without copying it
+	static lazy_stream<T> from_shared(std::shared_ptr<T> head_ptr, tail_gen_type tail_gen);
+
+	// Creates the stream seed followed by definition(self), where self is the stream itself
+	static lazy_stream<T> letrec(
+		const std::vector<T>& seed,
+		const std::function<lazy_stream<T> (const lazy_stream<T>& self)>& definition);
+
 	// Empty stream constructor
-	lazy_stream<T>() :
+	lazy_stream() :
 	head_ptr_(nullptr),
 	tail_ptr_(nullptr),
-	tail_gen_ptr_(nullptr),
+	tail_cell_ptr_(nullptr),
+	arithmetic_ptr_(nullptr),
 	empty_(true) {}
 
 	template <typename U>
@@ -103,10 +308,11 @@ public:
 			int
 		>::type=0
 	>
-	lazy_stream<T>(Head_Type&& head, U&& tail) :
-	head_ptr_(std::make_shared<head_type>(std::forward<Head_Type>(head))),
-	tail_ptr_(std::make_shared<tail_type>(std::forward<U>(tail))),
-	tail_gen_ptr_(nullptr),
+	lazy_stream(Head_Type&& head, U&& tail) :
+	head_ptr_(std::allocate_shared<head_type>(stream_allocator<head_type>(), std::forward<Head_Type>(head))),
+	tail_ptr_(std::allocate_shared<tail_type>(stream_allocator<tail_type>(), std::forward<U>(tail))),
+	tail_cell_ptr_(nullptr),
+	arithmetic_ptr_(nullptr),
 	empty_(false) {}
 
 	// Template constructor for:
@@ -129,35 +335,44 @@ public:
 			int
 		>::type=0
 	>
-	lazy_stream<T>(Head_Type&& head, U&& tail_gen) :
-	head_ptr_(std::make_shared<head_type>(std::forward<Head_Type>(head))),
+	lazy_stream(Head_Type&& head, U&& tail_gen) :
+	head_ptr_(std::allocate_shared<head_type>(stream_allocator<head_type>(), std::forward<Head_Type>(head))),
 	tail_ptr_(nullptr),
-	tail_gen_ptr_(std::make_shared<tail_gen_type>(std::forward<U>(tail_gen))),
+	tail_cell_ptr_(std::allocate_shared<tail_cell_type>(stream_allocator<tail_cell_type>(), std::forward<U>(tail_gen))),
+	arithmetic_ptr_(nullptr),
 	empty_(false) {}
 
 	// Copy constructor
-	lazy_stream<T>(const lazy_stream<T>& other) :
+	lazy_stream(const lazy_stream<T>& other) :
 	head_ptr_(other.head_ptr_),
 	tail_ptr_(other.tail_ptr_),
-	tail_gen_ptr_(other.tail_gen_ptr_),
+	tail_cell_ptr_(other.tail_cell_ptr_),
+	arithmetic_ptr_(other.arithmetic_ptr_),
 	empty_(other.empty_) {}
 
 	// Move constructor
-	lazy_stream<T>(lazy_stream<T>&& other) :
+	lazy_stream(lazy_stream<T>&& other) :
 	head_ptr_(std::move(other.head_ptr_)),
 	tail_ptr_(std::move(other.tail_ptr_)),
-	tail_gen_ptr_(std::move(other.tail_gen_ptr_)),
+	tail_cell_ptr_(std::move(other.tail_cell_ptr_)),
+	arithmetic_ptr_(std::move(other.arithmetic_ptr_)),
 	empty_(other.empty_) {}
 
+	// Destructor
+	~lazy_stream();
+
 	// Gets the stream first element (head)
 	auto head() const -> const head_type&;
 
-	// Creates the tail substream by removing the head
-	lazy_stream<T> tail() const;
+	// Gets the tail substream resulting from removing the head
+	auto tail() const -> const tail_type&;
 
 	// Is the stream empty?
 	bool empty() const {return empty_;}
 
+	// Gets the tail if it has been evaluated already, nullptr otherwise
+	const tail_type* evaluated_tail() const;
+
 	// Does the stream contain the value element?
 	bool contains(const T& value) const;
 
@@ -168,13 +383,16 @@ public:
 	bool exists(const predicate_fn_type& exist_fn) const;
 
 	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
-	lazy_stream<T> filter(const predicate_fn_type& filter_fn) const;
+	lazy_stream<T> filter(const predicate_fn_type& filter_fn) const&;
+
+	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate, releasing the rejected ones
+	lazy_stream<T> filter(const predicate_fn_type& filter_fn) &&;
 
 	// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
 	lazy_stream<T> filter_not(const predicate_fn_type& filter_fn) const;
 
 	// Gets the element of index n [0..)
-	auto get(size_t n) const -> const head_type&;
+	auto get(size_t n) const -> get_type;
 
 	// Creates a substream containing the first element satisfying the find_fn predicate
 	lazy_stream<T> find_first(const predicate_fn_type& find_fn) const;
@@ -186,20 +404,65 @@ public:
 	lazy_stream<T> take(size_t n) const;
 
 	// Creates the substream resulting from dropping the first n elements
-	lazy_stream<T> drop(size_t n) const;
+	lazy_stream<T> drop(size_t n) const&;
+
+	// Creates the substream resulting from dropping the first n elements, releasing them
+	lazy_stream<T> drop(size_t n) &&;
 
 	// Creates the substream whose head does not comply with drop_fn predicate
-	lazy_stream<T> drop_while(const predicate_fn_type& drop_fn) const;
+	lazy_stream<T> drop_while(const predicate_fn_type& drop_fn) const&;
+
+	// Creates the substream whose head does not comply with drop_fn predicate, releasing the dropped elements
+	lazy_stream<T> drop_while(const predicate_fn_type& drop_fn) &&;
 
 	// Creates the substream whose head complies with drop_fn predicate
 	lazy_stream<T> drop_while_not(const predicate_fn_type& drop_fn) const;
 
+	// Creates the stream of the blocks of n consecutive elements
+	lazy_stream<std::vector<T>> chunk(size_t n) const;
+
+	// Creates the stream of the windows of n consecutive elements, starting every step elements
+	lazy_stream<std::vector<T>> sliding(size_t n, size_t step=1) const;
+
+	// Creates the stream of the runs of consecutive elements for which same_fn holds pairwise
+	lazy_stream<std::vector<T>> batch_by(const std::function<bool (const T&, const T&)>& same_fn) const;
+
 	// Creates the reversed stream
 	lazy_stream<T> reverse() const;
 
 	// Pours the stream into a std::list
 	std::list<T> to_list() const;
 
+	// Pours the stream into a std::vector, reserving size_hint elements
+	std::vector<T> to_vector(size_t size_hint=0) const;
+
+	// Forward iterator over the memoized nodes of a stream
+	class const_iterator;
+
+	typedef const_iterator iterator;
+
+	// Gets an iterator to the first element
+	const_iterator begin() const;
+
+	// Gets the end iterator, equal to any iterator past the last element
+	const_iterator end() const;
+
+	// Input iterator consuming a stream: only its current node is kept alive
+	class consuming_iterator;
+
+	// Single-use range of consuming iterators over a stream
+	class consuming_range;
+
+	// Consumes the stream as a range, releasing each node once passed
+	consuming_range consume() &&;
+
+	// Applies fn to every element, releasing each node once passed
+	void for_each_consume(const std::function<void (const T&)>& fn) &&;
+
+	// Fold left reduction releasing each node once passed
+	template <typename U>
+	U fold_left_consume(const U& start, const std::function<U (const U&, const T&)>& fold_fn) &&;
+
 	// Creates a stream by applying the map_fn map
 	template <typename U>
 	lazy_stream<U> map(const std::function<U (const T&)>& map_fn) const;
@@ -208,10 +471,43 @@ public:
 	template <typename U>
 	std::function<U (const std::function<U (const U&, const T&)>&)> fold_left(const U& start) const;
 
+	// Creates the stream of the successive fold left reductions, from start on
+	template <typename U>
+	lazy_stream<U> scan_left(const U& start, const std::function<U (const U&, const T&)>& scan_fn) const;
+
 	// Left reduction
 	template <typename U>
 	std::function<U (const std::function<U (const U&, const T&)>&)> reduce_left() const;
 
+	// Fold left reduction run on chunks in parallel, partials merged with combine_fn
+	template <typename U>
+	U parallel_fold(
+		const U& start,
+		const std::function<U (const U&, const T&)>& fold_fn,
+		const std::function<U (const U&, const U&)>& combine_fn,
+		size_t chunk=default_parallel_chunk,
+		parallel_order order=ordered) const;
+
+	// Left reduction run on chunks in parallel, partials merged with combine_fn
+	template <typename U>
+	U parallel_reduce(
+		const std::function<U (const U&, const T&)>& reduce_fn,
+		const std::function<U (const U&, const U&)>& combine_fn,
+		size_t chunk=default_parallel_chunk,
+		parallel_order order=ordered) const;
+
+	// Creates a stream whose elements are evaluated up to n ahead on a background thread
+	lazy_stream<T> prefetch(size_t n) const;
+
+	// Splits the stream into k substreams that can be consumed from k threads concurrently
+	std::vector<lazy_stream<T>> partition(size_t k, partition_policy policy=round_robin,
+		size_t chunk=default_parallel_chunk) const;
+
+	// Splits the stream into k substreams by the hash of the key of each element
+	template <typename Key>
+	std::vector<lazy_stream<T>> partition_by(size_t k, const std::function<Key (const T&)>& key_fn,
+		size_t chunk=default_parallel_chunk) const;
+
 	// Creates a stream by pairing corresponding elements in this and other streams
 	template <typename U>
 	lazy_stream<std::pair<T, U>> zip(const lazy_stream<U>& other) const;
@@ -227,6 +523,152 @@ public:
 	// Creates a stream by prepending a value element to other stream
 	template <typename U>
 	friend lazy_stream<U> operator&(const U& value, const lazy_stream<U>& other);
+
+private:
+
+	// Folds the stream chunk by chunk on worker threads (private)
+	template <typename U, typename Chunk_Fn>
+	U parallel_fold_chunks(
+		const Chunk_Fn& chunk_fn,
+		const std::function<U (const U&, const U&)>& combine_fn,
+		size_t chunk,
+		parallel_order order) const;
+
+	// Ring buffer shared by a prefetching thread and its consumer stream
+	struct prefetch_state_type
+	{
+		std::mutex mutex_;
+		std::condition_variable not_empty_;
+		std::condition_variable not_full_;
+		std::vector<head_ptr_type> ring_;
+		size_t first_;
+		size_t count_;
+		bool done_;
+		bool cancelled_;
+		std::exception_ptr error_;
+		std::thread thread_;
+
+		explicit prefetch_state_type(size_t n) :
+		ring_(n),
+		first_(0),
+		count_(0),
+		done_(false),
+		cancelled_(false) {}
+
+		// Cancels and joins the prefetching thread
+		~prefetch_state_type();
+	};
+
+	// Source shared by the substreams of a round robin or hashed partition
+	//
+	// source_mutex_ is held by the one consumer reading a chunk from source_
+	// and dealing it out; mutex_ only guards the queues.
+	struct partition_state_type
+	{
+		std::mutex source_mutex_;
+		std::mutex mutex_;
+		lazy_stream<T> source_;										// Next element to read
+		std::function<size_t (const T&)> hash_fn_;					// Empty for round robin
+		size_t chunk_;
+		size_t next_;												// Round robin: substream of the next chunk
+		std::vector<std::vector<head_ptr_type>> staging_;			// Hashed: chunks being filled
+		std::vector<std::deque<std::vector<head_ptr_type>>> queues_;
+		bool done_;
+		std::exception_ptr error_;
+
+		partition_state_type(const lazy_stream<T>& source, const std::function<size_t (const T&)>& hash_fn,
+			size_t k, size_t chunk) :
+		source_(source),
+		hash_fn_(hash_fn),
+		chunk_(chunk),
+		next_(0),
+		staging_(k),
+		queues_(k),
+		done_(source.empty_) {}
+	};
+
+	// Position of a substream in the chunks dealt to it
+	struct partition_cursor_type
+	{
+		std::shared_ptr<partition_state_type> state_ptr_;
+		size_t index_;
+		std::vector<head_ptr_type> chunk_;
+		size_t next_;
+	};
+
+	// Shared state of a stream defined by letrec
+	struct knot_type
+	{
+		std::vector<T> seed_;
+		lazy_stream<T> definition_;	// Elements after the seed, at the last one pulled
+		size_t next_;				// Index of the next self node
+		bool defined_;
+		bool pulled_;
+
+		explicit knot_type(const std::vector<T>& seed) :
+		seed_(seed),
+		next_(0),
+		defined_(false),
+		pulled_(false) {}
+	};
+
+	// Creates the next node of the stream a letrec definition sees as itself (private)
+	static lazy_stream<T> knot_self(const std::shared_ptr<knot_type>& knot_ptr);
+
+	// Creates the stream letrec returns, sharing the heads of self (private)
+	static lazy_stream<T> knot_result(const std::shared_ptr<knot_type>& knot_ptr, const lazy_stream<T>& self);
+
+	// Evaluates the tail of cell once, or waits for the thread evaluating it (private)
+	void force_tail(tail_cell_type& cell) const;
+
+	// Creates the node of the arithmetic sequence arithmetic_ptr whose head is n (private)
+	static lazy_stream<T> arithmetic_from(const T& n, const arithmetic_ptr_type& arithmetic_ptr);
+
+	// Creates the tail of an arithmetic sequence node (private)
+	lazy_stream<T> arithmetic_tail() const;
+
+	// Gets the number of steps from the head to the last element of a finite arithmetic sequence (private)
+	uintmax_t arithmetic_steps() const;
+
+	// Creates the substream of an arithmetic sequence resulting from dropping the first n elements (private)
+	lazy_stream<T> arithmetic_drop(size_t n) const;
+
+	// Takes the tail out of this node if no other node shares it (private)
+	tail_ptr_type detach_tail();
+
+	// Skips to the first element of position satisfying filter_fn and filters on from there (private)
+	static lazy_stream<T> filter_from(lazy_stream<T>& position, const predicate_fn_type& filter_fn);
+
+	// Cuts the blocks of n elements starting at position (private)
+	static lazy_stream<std::vector<T>> chunk_from(lazy_stream<T> position, size_t n);
+
+	// Slides the windows following window, whose next element is at position (private)
+	static lazy_stream<std::vector<T>> sliding_from(
+		lazy_stream<T> position,
+		const std::vector<T>& window,
+		size_t n,
+		size_t step);
+
+	// Cuts the runs starting at position (private)
+	static lazy_stream<std::vector<T>> batch_from(
+		lazy_stream<T> position,
+		const std::function<bool (const T&, const T&)>& same_fn);
+
+	// Gets the parking stripe of cell (private)
+	static parking_stripe_type& parking_stripe(const tail_cell_type* cell);
+
+	// Pops the next prefetched element into a stream (private)
+	static lazy_stream<T> prefetch_pull(const std::shared_ptr<prefetch_state_type>& state_ptr);
+
+	// Splits the stream into k substreams fed chunk by chunk from a shared source (private)
+	std::vector<lazy_stream<T>> partition_chunks(size_t k, const std::function<size_t (const T&)>& hash_fn,
+		size_t chunk) const;
+
+	// Gets the next chunk of substream index, reading the source if needed. False at the end (private)
+	static bool partition_refill(partition_state_type& state, size_t index, std::vector<head_ptr_type>& chunk);
+
+	// Creates the rest of a substream from its cursor (private)
+	static lazy_stream<T> partition_pull(const std::shared_ptr<partition_cursor_type>& cursor_ptr);
 };
 
 
@@ -235,20 +677,32 @@ template <typename T>
 lazy_stream<T> lazy_stream<T>::nil;
 
 
+// Default number of elements per chunk in parallel_fold and parallel_reduce
+template <typename T>
+const size_t lazy_stream<T>::default_parallel_chunk;
+
+
 // Creates the stream: {n, n+1, n+2,...}
 template <typename T>
 lazy_stream<T> lazy_stream<T>::from(const T& n)
 {
-	return lazy_stream<T>(n, [n]() -> lazy_stream<T> {
-		return lazy_stream<T>::from(n+T(1), T(1));
-		});
+	return from(n, T(1));
 }
 
 
 // Creates the stream: {n, n+step, n+2*step,...}
+//
+// For integral types with a non-zero step this is an arithmetic sequence
+// whose get, drop, take and contains are computed in constant time. Any
+// other operator walks its nodes as usual.
+//
 template <typename T>
 lazy_stream<T> lazy_stream<T>::from(const T& n, const T& step)
 {
+	if(arithmetic_traits::closed(step))
+		return arithmetic_from(n, std::allocate_shared<arithmetic_type>(
+			stream_allocator<arithmetic_type>(), arithmetic_type{step, n, true}));
+
 	return lazy_stream<T>(n, [n, step]() -> lazy_stream<T> {
 		return lazy_stream<T>::from(n+step, step);
 		});
@@ -270,246 +724,1081 @@ lazy_stream<T> lazy_stream<T>::range(const T& from, const T& to)
 
 
 // Creates the stream: [from..to) with a step
+//
+// For integral types with a non-zero step this is a finite arithmetic
+// sequence, whose size is also computed in constant time.
+//
 template <typename T>
 lazy_stream<T> lazy_stream<T>::range(const T& from, const T& to, const T& step)
 {
-	if((to>from && step>=T(0)) || (from>to && step<=T(0)))
-		return lazy_stream<T>(from, [from, to, step]() -> lazy_stream<T> {
-			return lazy_stream<T>::range(from+step, to, step);
-			});
-
-	return lazy_stream<T>();
-}
+	if(!((to>from && step>=T(0)) || (from>to && step<=T(0))))
+		return lazy_stream<T>();
 
+	if(arithmetic_traits::closed(step))
+	{
+		uintmax_t steps=(arithmetic_traits::span(from, to, step)-1)/arithmetic_traits::stride(step);
 
-// Assignment operator (private)
-template <typename T>
-lazy_stream<T>& lazy_stream<T>::operator=(const lazy_stream<T>& other)
-{
-	head_ptr_=other.head_ptr_;
-	tail_ptr_=other.tail_ptr_;
-	tail_gen_ptr_=other.tail_gen_ptr_;
-	empty_=other.empty_;
+		return arithmetic_from(from, std::allocate_shared<arithmetic_type>(
+			stream_allocator<arithmetic_type>(),
+			arithmetic_type{step, arithmetic_traits::advance(from, steps, step), false}));
+	}
 
-	return *this;
+	return lazy_stream<T>(from, [from, to, step]() -> lazy_stream<T> {
+		return lazy_stream<T>::range(from+step, to, step);
+		});
 }
 
 
-// Move assignment operator (private)
+// Creates a stream whose head is shared with head_ptr, without copying it
+//
+// head_ptr may be an aliasing pointer that keeps some larger storage, such
+// as a memory mapping, alive for as long as the node exists.
+//
 template <typename T>
-lazy_stream<T>& lazy_stream<T>::operator=(lazy_stream<T>&& other)
+lazy_stream<T> lazy_stream<T>::from_shared(std::shared_ptr<T> head_ptr, tail_gen_type tail_gen)
 {
-	head_ptr_=std::move(other.head_ptr_);
-	tail_ptr_=std::move(other.tail_ptr_);
-	tail_gen_ptr_=std::move(other.tail_gen_ptr_);
-	empty_=other.empty_;
-
-	return *this;
-}
+	if(!head_ptr)
+		throw std::invalid_argument("Class: lazy_stream<>. Null head pointer.");
 
+	lazy_stream<T> accu;
 
-// Gets the stream first element (head)
-template <typename T>
-auto lazy_stream<T>::head() const -> const head_type&
-{
-	if(empty_)
-		throw std::range_error("Class: lazy_stream<>. No head in empty stream.");
+	accu.head_ptr_=std::move(head_ptr);
+	accu.tail_cell_ptr_=std::allocate_shared<tail_cell_type>(stream_allocator<tail_cell_type>(), std::move(tail_gen));
+	accu.empty_=false;
 
-	return *head_ptr_;
+	return accu;
 }
 
 
-// Creates the tail substream by removing the head
+// Creates the stream seed followed by definition(self), where self is the stream itself
+//
+// Lets a stream be defined in terms of its own earlier elements, as in
+//
+// fibs=letrec({0, 1}, [](const lazy_stream<long>& self) {
+// 	return self.zip(self.tail()).map(sum);
+// 	});
+//
+// definition is called once, with self starting at the seed. Every element
+// is evaluated once and read back from the memoized nodes of self, so the
+// n first elements cost O(n). definition may only read elements of self
+// before the one it is producing: reading that one or a later one throws
+// std::logic_error.
+//
+// self holds its shared state weakly and the returned stream holds it
+// strongly, so the nodes the definition keeps of self form no cycle and
+// everything is released with the returned stream. self must not be used
+// once every node of the returned stream is gone.
+//
 template <typename T>
-lazy_stream<T> lazy_stream<T>::tail() const
+lazy_stream<T> lazy_stream<T>::letrec(
+	const std::vector<T>& seed,
+	const std::function<lazy_stream<T> (const lazy_stream<T>& self)>& definition)
 {
-	if(empty_)
-		throw std::range_error("Class: lazy_stream<>. No tail in empty stream.");
+	if(seed.empty())
+		throw std::invalid_argument("Class: lazy_stream<>. A recursive definition needs a seed.");
 
-	if(tail_ptr_)
-		return *tail_ptr_;
+	std::shared_ptr<knot_type> knot_ptr=std::make_shared<knot_type>(seed);
+	lazy_stream<T> self=knot_self(knot_ptr);
 
-	return (*tail_gen_ptr_)();
+	knot_ptr->definition_=definition(self);
+	knot_ptr->defined_=true;
+
+	return knot_result(knot_ptr, self);
 }
 
 
-// Does the stream contain the value element?
+// Creates the next node of the stream a letrec definition sees as itself (private)
+//
+// The nodes are created in order, each one when the tail of the previous
+// one is forced, so the pulls from the definition never overlap.
+//
 template <typename T>
-bool lazy_stream<T>::contains(const T& value) const
+lazy_stream<T> lazy_stream<T>::knot_self(const std::shared_ptr<knot_type>& knot_ptr)
 {
-	if(empty_)
-		return false;
+	knot_type& knot=*knot_ptr;
+	head_ptr_type head_ptr;
 
-	if(value==*head_ptr_)
-		return true;
+	if(knot.next_<knot.seed_.size())
+		head_ptr=std::allocate_shared<head_type>(stream_allocator<head_type>(), knot.seed_[knot.next_]);
+	else
+	{
+		if(!knot.defined_)
+			throw std::logic_error("Class: lazy_stream<>. Recursive definition reads past its seed.");
 
-	return tail().contains(value);
-}
+		if(knot.pulled_)
+			knot.definition_=knot.definition_.tail();
 
+		knot.pulled_=true;
 
-// Gets the number of elements in the stream
-template <typename T>
-size_t lazy_stream<T>::size() const
-{
-	size_t accu=0;
-	lazy_stream<T> temp=*this;
+		if(knot.definition_.empty_)
+			return lazy_stream<T>();
 
-	while(!temp.empty_)
-	{
-		++accu;
-		temp=temp.tail();
+		head_ptr=knot.definition_.head_ptr_;
 	}
 
-	return accu;
-}
+	++knot.next_;
 
+	std::weak_ptr<knot_type> weak_knot_ptr=knot_ptr;
 
-// Does any element comply with exist_fn predicate?
-template <typename T>
-bool lazy_stream<T>::exists(const predicate_fn_type& exist_fn) const
-{
-	if(empty_)
-		return false;
+	return from_shared(head_ptr, [weak_knot_ptr]() -> lazy_stream<T> {
+		std::shared_ptr<knot_type> knot_ptr=weak_knot_ptr.lock();
 
-	if(exist_fn(*head_ptr_))
-		return true;
+		if(!knot_ptr)
+			throw std::logic_error("Class: lazy_stream<>. Recursive definition used after its stream.");
 
-	return tail().exists(exist_fn);
+		return knot_self(knot_ptr);
+		});
 }
 
 
-// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+// Creates the stream letrec returns, sharing the heads of self (private)
 template <typename T>
-lazy_stream<T> lazy_stream<T>::filter(const predicate_fn_type& filter_fn) const
+lazy_stream<T> lazy_stream<T>::knot_result(const std::shared_ptr<knot_type>& knot_ptr, const lazy_stream<T>& self)
 {
-	if(empty_)
+	if(self.empty_)
 		return lazy_stream<T>();
 
-	const tail_type& tail_=tail();
-
-	if(filter_fn(*head_ptr_))
-		return lazy_stream<T>(*head_ptr_, [tail_, filter_fn]() -> lazy_stream<T> {
-			return tail_.filter(filter_fn);
-			});
-
-	return tail_.filter(filter_fn);
+	return from_shared(self.head_ptr_, [knot_ptr, self]() -> lazy_stream<T> {
+		return knot_result(knot_ptr, self.tail());
+		});
 }
 
 
-// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+// Creates the node of the arithmetic sequence arithmetic_ptr whose head is n (private)
+//
+// The node has no tail generator: its tail is computed from the closed form.
+//
 template <typename T>
-lazy_stream<T> lazy_stream<T>::filter_not(const predicate_fn_type& filter_fn) const
+lazy_stream<T> lazy_stream<T>::arithmetic_from(const T& n, const arithmetic_ptr_type& arithmetic_ptr)
 {
-	return filter(std::not1<predicate_fn_type>(filter_fn));
-}
-
+	lazy_stream<T> accu;
 
-// Gets the element of index n [0..)
-template <typename T>
-auto lazy_stream<T>::get(size_t n) const -> const head_type&
-{
-	if(n==0)
-		return head();
+	accu.head_ptr_=std::allocate_shared<head_type>(stream_allocator<head_type>(), n);
+	accu.tail_cell_ptr_=std::allocate_shared<tail_cell_type>(stream_allocator<tail_cell_type>(), tail_gen_type());
+	accu.arithmetic_ptr_=arithmetic_ptr;
+	accu.empty_=false;
 
-	return tail().get(n-1);
+	return accu;
 }
 
 
-// Creates a substream containing the first element satisfying the find_fn predicate
+// Creates the tail of an arithmetic sequence node (private)
 template <typename T>
-lazy_stream<T> lazy_stream<T>::find_first(const predicate_fn_type& find_fn) const
+lazy_stream<T> lazy_stream<T>::arithmetic_tail() const
 {
-	if(empty_)
-		return lazy_stream<T>();
+	const arithmetic_type& sequence=*arithmetic_ptr_;
 
-	if(find_fn(*head_ptr_))
-		return lazy_stream<T>(*head_ptr_, lazy_stream<T>());
+	if(!sequence.infinite_ && arithmetic_steps()==0)
+		return lazy_stream<T>();
 
-	return tail().find(find_fn);
+	return arithmetic_from(arithmetic_traits::advance(*head_ptr_, 1, sequence.step_), arithmetic_ptr_);
 }
 
 
-// Creates a substream containing the first element not satisfying the find_fn predicate
+// Gets the number of steps from the head to the last element of a finite arithmetic sequence (private)
 template <typename T>
-lazy_stream<T> lazy_stream<T>::find_first_not(const predicate_fn_type& find_fn) const
+uintmax_t lazy_stream<T>::arithmetic_steps() const
 {
-	return find_first(std::not1<predicate_fn_type>(find_fn));
+	const arithmetic_type& sequence=*arithmetic_ptr_;
+
+	return arithmetic_traits::span(*head_ptr_, sequence.last_, sequence.step_)/arithmetic_traits::stride(sequence.step_);
 }
 
 
-// Creates the substream of the first n elements
+// Creates the substream of an arithmetic sequence resulting from dropping the first n elements (private)
 template <typename T>
-lazy_stream<T> lazy_stream<T>::take(size_t n) const
+lazy_stream<T> lazy_stream<T>::arithmetic_drop(size_t n) const
 {
-	if(empty_ || n<1)
-		return lazy_stream<T>();
+	if(n<1)
+		return *this;
 
-	const tail_type& tail_=tail();
+	if(!arithmetic_ptr_->infinite_ && n>arithmetic_steps())
+		return lazy_stream<T>();
 
-	return lazy_stream<T>(*head_ptr_, [tail_, n]() -> lazy_stream<T> {return tail_.take(n-1);});
+	return arithmetic_from(arithmetic_traits::advance(*head_ptr_, n, arithmetic_ptr_->step_), arithmetic_ptr_);
 }
 
 
-// Creates the substream resulting from dropping the first n elements
+// Assignment operator (private)
+//
+// other may be owned by this stream, as in temp=temp.tail(), so it is
+// copied before anything here is released.
+//
 template <typename T>
-lazy_stream<T> lazy_stream<T>::drop(size_t n) const
+lazy_stream<T>& lazy_stream<T>::operator=(const lazy_stream<T>& other)
 {
-	if(empty_ || n<1)
-		return *this;
+	lazy_stream<T> copy(other);
 
-	return tail().drop(n-1);
+	return *this=std::move(copy);
 }
 
 
-// Creates the substream whose head does not comply with drop_fn predicate
+// Move assignment operator (private)
 template <typename T>
-lazy_stream<T> lazy_stream<T>::drop_while(const predicate_fn_type& drop_fn) const
+lazy_stream<T>& lazy_stream<T>::operator=(lazy_stream<T>&& other)
 {
-	if(empty_)
-		return lazy_stream<T>();
-
-	if(drop_fn(*head_ptr_))
-		return tail().drop_while(drop_fn);
+	head_ptr_=std::move(other.head_ptr_);
+	tail_ptr_=std::move(other.tail_ptr_);
+	tail_cell_ptr_=std::move(other.tail_cell_ptr_);
+	arithmetic_ptr_=std::move(other.arithmetic_ptr_);
+	empty_=other.empty_;
 
 	return *this;
 }
 
 
-// Creates the substream whose head complies with drop_fn predicate
+// Destructor
+//
+// Letting the members go would destroy a memoized chain one recursive call
+// per node and overflow the stack on long streams. Instead, the tail of
+// every node owned by nobody else is taken out before the node dies, so the
+// chain is released in a loop.
+//
 template <typename T>
-lazy_stream<T> lazy_stream<T>::drop_while_not(const predicate_fn_type& drop_fn) const
+lazy_stream<T>::~lazy_stream()
 {
-	return drop_while(std::not1<predicate_fn_type>(drop_fn));
+	tail_ptr_type next=detach_tail();
+
+	while(next && next.use_count()==1)
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);	// Pairs with the release of the other owners
+
+		tail_ptr_type after=next->detach_tail();
+
+		next=std::move(after);	// Destroys a node without a tail
+	}
 }
 
 
-// Creates the reversed stream
+// Takes the tail out of this node if no other node shares it (private)
+//
+// A shared tail cell is left alone: some other copy of this node may still
+// force or read it. So is a cell not yet ready, whose generator may hold
+// the rest of the stream. use_count() is a relaxed load: the fence orders
+// the reads of the last other owner, e.g. a prefetching thread, before the
+// tail is taken out.
+//
 template <typename T>
-lazy_stream<T> lazy_stream<T>::reverse() const
+auto lazy_stream<T>::detach_tail() -> tail_ptr_type
+{
+	if(tail_ptr_)
+		return std::move(tail_ptr_);
+
+	if(tail_cell_ptr_ && tail_cell_ptr_.use_count()==1)
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);	// Pairs with the release of the other owners
+
+		if(tail_cell_ptr_->state_.load(std::memory_order_acquire)==tail_cell_type::ready)
+			return std::move(tail_cell_ptr_->tail_ptr_);
+	}
+
+	return nullptr;
+}
+
+
+// Gets the tail if it has been evaluated already, nullptr otherwise
+template <typename T>
+auto lazy_stream<T>::evaluated_tail() const -> const tail_type*
+{
+	if(tail_ptr_)
+		return tail_ptr_.get();
+
+	if(tail_cell_ptr_ && tail_cell_ptr_->state_.load(std::memory_order_acquire)==tail_cell_type::ready)
+		return tail_cell_ptr_->tail_ptr_.get();
+
+	return nullptr;
+}
+
+
+// Gets the stream first element (head)
+template <typename T>
+auto lazy_stream<T>::head() const -> const head_type&
+{
+	if(empty_)
+		throw std::range_error("Class: lazy_stream<>. No head in empty stream.");
+
+	return *head_ptr_;
+}
+
+
+// Gets the tail substream resulting from removing the head
+//
+// The tail generator runs at most once per node, even when several threads
+// force the same tail: its result is memoized in the shared tail cell, so
+// every copy of this stream sees the same tail. Once the tail is ready this
+// is a single atomic load, and the reference stays valid for as long as this
+// node is alive, so walking a stream by reference costs no copy at all.
+//
+template <typename T>
+auto lazy_stream<T>::tail() const -> const tail_type&
+{
+	if(empty_)
+		throw std::range_error("Class: lazy_stream<>. No tail in empty stream.");
+
+	if(tail_ptr_)
+		return *tail_ptr_;
+
+	tail_cell_type& cell=*tail_cell_ptr_;
+
+	if(cell.state_.load(std::memory_order_acquire)!=tail_cell_type::ready)
+		force_tail(cell);
+
+	return *cell.tail_ptr_;
+}
+
+
+// Evaluates the tail of cell once, or waits for the thread evaluating it (private)
+//
+// Waiting threads park on a condition variable instead of spinning. The
+// evaluating thread only takes the stripe lock when it has been told, through
+// the evaluating_waited state, that somebody is waiting.
+//
+// While the tail is evaluated, the arena of the cell is made the current
+// one, so that the tail and every node its generator creates are allocated
+// where the node itself was, or on the heap if that arena belongs to
+// another thread.
+//
+template <typename T>
+void lazy_stream<T>::force_tail(tail_cell_type& cell) const
+{
+	for(;;)
+	{
+		int state=tail_cell_type::unevaluated;
+
+		if(cell.state_.compare_exchange_strong(state, tail_cell_type::evaluating, std::memory_order_acquire))
+		{
+			int next_state=tail_cell_type::ready;
+			std::exception_ptr error;
+			lazy_stream_detail::evaluation_frame frame={&cell, lazy_stream_detail::evaluation_stack()};
+			stream_arena* ambient=stream_arena::current();
+
+			lazy_stream_detail::evaluation_stack()=&frame;
+			stream_arena::current()=cell.arena_ && cell.arena_->owned_here() ? cell.arena_ : nullptr;
+
+			try
+			{
+				cell.tail_ptr_=std::allocate_shared<tail_type>(stream_allocator<tail_type>(),
+					arithmetic_ptr_ ? arithmetic_tail() : cell.tail_gen_());
+				cell.tail_gen_=nullptr;	// Releases the captured state
+			}
+			catch(...)
+			{
+				next_state=tail_cell_type::unevaluated;	// The next forcing thread tries again
+				error=std::current_exception();
+			}
+
+			stream_arena::current()=ambient;
+			lazy_stream_detail::evaluation_stack()=frame.next_;
+
+			if(cell.state_.exchange(next_state, std::memory_order_release)==tail_cell_type::evaluating_waited)
+			{
+				parking_stripe_type& stripe=parking_stripe(&cell);
+				{std::lock_guard<std::mutex> lock(stripe.mutex_);}
+				stripe.ready_.notify_all();
+			}
+
+			if(error)
+				std::rethrow_exception(error);
+
+			return;
+		}
+
+		if(state==tail_cell_type::ready)
+			return;
+
+		// Waiting for a tail this thread is evaluating would never end
+		for(lazy_stream_detail::evaluation_frame* frame=lazy_stream_detail::evaluation_stack(); frame; frame=frame->next_)
+			if(frame->cell_==&cell)
+				throw std::logic_error("Class: lazy_stream<>. Tail defined in terms of itself.");
+
+		// Another thread is evaluating the tail: tells it there are waiters
+		if(state==tail_cell_type::evaluating &&
+			!cell.state_.compare_exchange_strong(state, tail_cell_type::evaluating_waited, std::memory_order_acquire))
+			continue;
+
+		parking_stripe_type& stripe=parking_stripe(&cell);
+		std::unique_lock<std::mutex> lock(stripe.mutex_);
+
+		stripe.ready_.wait(lock, [&cell](){
+			return cell.state_.load(std::memory_order_acquire)!=tail_cell_type::evaluating_waited;
+			});
+	}
+}
+
+
+// Gets the parking stripe of cell (private)
+template <typename T>
+auto lazy_stream<T>::parking_stripe(const tail_cell_type* cell) -> parking_stripe_type&
+{
+	static parking_stripe_type stripes[64];
+
+	return stripes[(reinterpret_cast<uintptr_t>(cell)/sizeof(tail_cell_type))%64];
+}
+
+
+// Does the stream contain the value element?
+template <typename T>
+bool lazy_stream<T>::contains(const T& value) const
+{
+	if(arithmetic_ptr_)
+	{
+		const arithmetic_type& sequence=*arithmetic_ptr_;
+
+		if(!arithmetic_traits::ahead(*head_ptr_, value, sequence.step_))
+			return false;
+
+		uintmax_t span=arithmetic_traits::span(*head_ptr_, value, sequence.step_);
+		uintmax_t stride=arithmetic_traits::stride(sequence.step_);
+
+		return span%stride==0 && (sequence.infinite_ || span/stride<=arithmetic_steps());
+	}
+
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		if(value==*temp->head_ptr_)
+			return true;
+
+		temp=&temp->tail();
+	}
+
+	return false;
+}
+
+
+// Gets the number of elements in the stream
+template <typename T>
+size_t lazy_stream<T>::size() const
+{
+	if(arithmetic_ptr_ && !arithmetic_ptr_->infinite_)
+		return size_t(arithmetic_steps()+1);
+
+	size_t accu=0;
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		++accu;
+		temp=&temp->tail();
+	}
+
+	return accu;
+}
+
+
+// Does any element comply with exist_fn predicate?
+template <typename T>
+bool lazy_stream<T>::exists(const predicate_fn_type& exist_fn) const
+{
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		if(exist_fn(*temp->head_ptr_))
+			return true;
+
+		temp=&temp->tail();
+	}
+
+	return false;
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::filter(const predicate_fn_type& filter_fn) const&
+{
+	lazy_stream<T> position(*this);
+
+	return filter_from(position, filter_fn);
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate, releasing the rejected ones
+//
+// A stream filtered as a temporary, as in range(0, n).filter(fn), no longer
+// holds its head while the leading rejected elements are skipped.
+//
+template <typename T>
+lazy_stream<T> lazy_stream<T>::filter(const predicate_fn_type& filter_fn) &&
+{
+	lazy_stream<T> position(std::move(*this));
+
+	return filter_from(position, filter_fn);
+}
+
+
+// Skips to the first element of position satisfying filter_fn and filters on from there (private)
+//
+// position moves forward in place, so the rejected nodes are released as
+// they are skipped, and a generator that throws while skipping resumes from
+// the failing element when its tail is forced again.
+//
+template <typename T>
+lazy_stream<T> lazy_stream<T>::filter_from(lazy_stream<T>& position, const predicate_fn_type& filter_fn)
+{
+	while(!position.empty_ && !filter_fn(*position.head_ptr_))
+		position=position.tail();
+
+	if(position.empty_)
+		return lazy_stream<T>();
+
+	lazy_stream<T> rest(position.tail());
+
+	return lazy_stream<T>(*position.head_ptr_, [rest, filter_fn]() mutable -> lazy_stream<T> {
+		return filter_from(rest, filter_fn);
+		});
+}
+
+
+// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::filter_not(const predicate_fn_type& filter_fn) const
+{
+	return filter([filter_fn](const T& value) {return !filter_fn(value);});
+}
+
+
+// Gets the element of index n [0..)
+template <typename T>
+auto lazy_stream<T>::get(size_t n) const -> get_type
+{
+	if(arithmetic_ptr_)
+	{
+		if(!arithmetic_ptr_->infinite_ && n>arithmetic_steps())
+			throw std::range_error("Class: lazy_stream<>. Index out of range.");
+
+		return arithmetic_traits::advance(*head_ptr_, n, arithmetic_ptr_->step_);
+	}
+
+	const lazy_stream<T>* temp=this;
+
+	for(; n>0; --n)
+		temp=&temp->tail();
+
+	return temp->head();
+}
+
+
+// Creates a substream containing the first element satisfying the find_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::find_first(const predicate_fn_type& find_fn) const
+{
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		if(find_fn(*temp->head_ptr_))
+			return lazy_stream<T>(*temp->head_ptr_, lazy_stream<T>());
+
+		temp=&temp->tail();
+	}
+
+	return lazy_stream<T>();
+}
+
+
+// Creates a substream containing the first element not satisfying the find_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::find_first_not(const predicate_fn_type& find_fn) const
+{
+	return find_first([find_fn](const T& value) {return !find_fn(value);});
+}
+
+
+// Creates the substream of the first n elements
+template <typename T>
+lazy_stream<T> lazy_stream<T>::take(size_t n) const
+{
+	if(empty_ || n<1)
+		return lazy_stream<T>();
+
+	if(arithmetic_ptr_)
+	{
+		const arithmetic_type& sequence=*arithmetic_ptr_;
+
+		if(!sequence.infinite_ && n-1>=arithmetic_steps())
+			return *this;
+
+		return arithmetic_from(*head_ptr_, std::allocate_shared<arithmetic_type>(
+			stream_allocator<arithmetic_type>(),
+			arithmetic_type{sequence.step_, arithmetic_traits::advance(*head_ptr_, n-1, sequence.step_), false}));
+	}
+
+	if(n==1)
+		return lazy_stream<T>(*head_ptr_, lazy_stream<T>());
+
+	lazy_stream<T> node(*this);
+
+	return lazy_stream<T>(*head_ptr_, [node, n]() -> lazy_stream<T> {return node.tail().take(n-1);});
+}
+
+
+// Creates the substream resulting from dropping the first n elements
+template <typename T>
+lazy_stream<T> lazy_stream<T>::drop(size_t n) const&
+{
+	if(arithmetic_ptr_)
+		return arithmetic_drop(n);
+
+	const lazy_stream<T>* temp=this;
+
+	for(; n>0 && !temp->empty_; --n)
+		temp=&temp->tail();
+
+	return *temp;
+}
+
+
+// Creates the substream resulting from dropping the first n elements, releasing them
+template <typename T>
+lazy_stream<T> lazy_stream<T>::drop(size_t n) &&
+{
+	if(arithmetic_ptr_)
+		return arithmetic_drop(n);
+
+	lazy_stream<T> position(std::move(*this));
+
+	for(; n>0 && !position.empty_; --n)
+		position=position.tail();
+
+	return position;
+}
+
+
+// Creates the substream whose head does not comply with drop_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::drop_while(const predicate_fn_type& drop_fn) const&
+{
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_ && drop_fn(*temp->head_ptr_))
+		temp=&temp->tail();
+
+	return *temp;
+}
+
+
+// Creates the substream whose head does not comply with drop_fn predicate, releasing the dropped elements
+template <typename T>
+lazy_stream<T> lazy_stream<T>::drop_while(const predicate_fn_type& drop_fn) &&
+{
+	lazy_stream<T> position(std::move(*this));
+
+	while(!position.empty_ && drop_fn(*position.head_ptr_))
+		position=position.tail();
+
+	return position;
+}
+
+
+// Creates the substream whose head complies with drop_fn predicate
+template <typename T>
+lazy_stream<T> lazy_stream<T>::drop_while_not(const predicate_fn_type& drop_fn) const
+{
+	return drop_while([drop_fn](const T& value) {return !drop_fn(value);});
+}
+
+
+// Creates the stream of the blocks of n consecutive elements
+//
+// Every block but the last one has n elements. Each block is filled in a
+// single pass and is a single node of the resulting stream.
+//
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::chunk(size_t n) const
+{
+	if(n<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Chunk size must be positive.");
+
+	return chunk_from(*this, n);
+}
+
+
+// Cuts the blocks of n elements starting at position (private)
+//
+// position is a copy: if forcing an element throws, forcing the block again
+// starts it over from the same element.
+//
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::chunk_from(lazy_stream<T> position, size_t n)
+{
+	if(position.empty_)
+		return lazy_stream<std::vector<T>>();
+
+	std::vector<T> block;
+	block.reserve(n);
+
+	while(block.size()<n && !position.empty_)
+	{
+		block.push_back(*position.head_ptr_);
+		position=position.tail();
+	}
+
+	return lazy_stream<std::vector<T>>(std::move(block), [position, n]() -> lazy_stream<std::vector<T>> {
+		return chunk_from(position, n);
+		});
+}
+
+
+// Creates the stream of the windows of n consecutive elements, starting every step elements
+//
+// Only whole windows are produced. Every element is forced once: a window
+// overlapping the previous one copies the shared elements from it instead
+// of walking them again.
+//
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::sliding(size_t n, size_t step) const
+{
+	if(n<1 || step<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Window size and step must be positive.");
+
+	return sliding_from(*this, std::vector<T>(), n, step);
+}
+
+
+// Slides the windows following window, whose next element is at position (private)
+//
+// An empty window stands for the start of the stream.
+//
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::sliding_from(
+	lazy_stream<T> position,
+	const std::vector<T>& window,
+	size_t n,
+	size_t step)
+{
+	std::vector<T> next;
+	size_t skip=0;
+
+	next.reserve(n);
+
+	if(!window.empty())
+	{
+		if(step<n)
+			next.assign(window.begin()+step, window.end());
+		else
+			skip=step-n;
+	}
+
+	for(; skip>0 && !position.empty_; --skip)
+		position=position.tail();
+
+	while(next.size()<n && !position.empty_)
+	{
+		next.push_back(*position.head_ptr_);
+		position=position.tail();
+	}
+
+	if(next.size()<n)
+		return lazy_stream<std::vector<T>>();
+
+	// The generator reads the window back from the node head, without copying it
+	std::shared_ptr<std::vector<T>> window_ptr=
+		std::allocate_shared<std::vector<T>>(stream_allocator<std::vector<T>>(), std::move(next));
+
+	return lazy_stream<std::vector<T>>::from_shared(window_ptr,
+		[position, window_ptr, n, step]() -> lazy_stream<std::vector<T>> {
+			return sliding_from(position, *window_ptr, n, step);
+			});
+}
+
+
+// Creates the stream of the runs of consecutive elements for which same_fn holds pairwise
+//
+// An element joins the current run when same_fn(previous, element) is
+// true, and starts a new one otherwise.
+//
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::batch_by(const std::function<bool (const T&, const T&)>& same_fn) const
+{
+	return batch_from(*this, same_fn);
+}
+
+
+// Cuts the runs starting at position (private)
+template <typename T>
+lazy_stream<std::vector<T>> lazy_stream<T>::batch_from(
+	lazy_stream<T> position,
+	const std::function<bool (const T&, const T&)>& same_fn)
+{
+	if(position.empty_)
+		return lazy_stream<std::vector<T>>();
+
+	std::vector<T> block(1, *position.head_ptr_);
+	position=position.tail();
+
+	while(!position.empty_ && same_fn(block.back(), *position.head_ptr_))
+	{
+		block.push_back(*position.head_ptr_);
+		position=position.tail();
+	}
+
+	return lazy_stream<std::vector<T>>(std::move(block), [position, same_fn]() -> lazy_stream<std::vector<T>> {
+		return batch_from(position, same_fn);
+		});
+}
+
+
+// Creates the reversed stream
+template <typename T>
+lazy_stream<T> lazy_stream<T>::reverse() const
 {
 	lazy_stream<T> accu;
-	lazy_stream<T> temp=*this;
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		accu=cons(*temp->head_ptr_, accu);
+		temp=&temp->tail();
+	}
+
+	return accu;
+}
+
+
+// Pours the stream into a std::list
+template <typename T>
+std::list<T> lazy_stream<T>::to_list() const
+{
+	std::list<T> accu;
+	const lazy_stream<T>* temp=this;
+
+	while(!temp->empty_)
+	{
+		accu.push_back(*temp->head_ptr_);
+		temp=&temp->tail();
+	}
+
+	return accu;
+}
+
+
+// Pours the stream into a std::vector, reserving size_hint elements
+//
+// The size of a finite arithmetic sequence is known and reserved anyway.
+//
+template <typename T>
+std::vector<T> lazy_stream<T>::to_vector(size_t size_hint) const
+{
+	std::vector<T> accu;
+	const lazy_stream<T>* temp=this;
+
+	if(arithmetic_ptr_ && !arithmetic_ptr_->infinite_)
+		size_hint=size();
+
+	accu.reserve(size_hint);
+
+	while(!temp->empty_)
+	{
+		accu.push_back(*temp->head_ptr_);
+		temp=&temp->tail();
+	}
+
+	return accu;
+}
+
+
+// Forward iterator over the memoized nodes of a stream
+//
+// The iterator points to a node, so it stays valid for as long as the
+// stream it was taken from is alive, and a copy walks the same elements
+// again without evaluating them twice. Comparing with end() only checks
+// whether the node is empty, so infinite streams never need to be walked
+// to their (missing) end: with iterators and std::ranges algorithms
+// end() acts as a sentinel.
+//
+template <typename T>
+class lazy_stream<T>::const_iterator
+{
+	const lazy_stream<T>* node_;	// Null for end()
+
+	// Is the iterator past the last element?
+	bool at_end() const {return !node_ || node_->empty_;}
+
+public:
+
+	typedef std::forward_iterator_tag iterator_category;
+	typedef T value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const T* pointer;
+	typedef const T& reference;
+
+	// End iterator
+	const_iterator() :
+	node_(nullptr) {}
+
+	// Iterator to the head of node
+	explicit const_iterator(const lazy_stream<T>* node) :
+	node_(node) {}
+
+	const T& operator*() const {return *node_->head_ptr_;}
+
+	const T* operator->() const {return node_->head_ptr_.get();}
+
+	const_iterator& operator++()
+	{
+		node_=&node_->tail();
+		return *this;
+	}
+
+	const_iterator operator++(int)
+	{
+		const_iterator accu(*this);
+		++*this;
+		return accu;
+	}
+
+	bool operator==(const const_iterator& other) const
+	{
+		return node_==other.node_ || (at_end() && other.at_end());
+	}
+
+	bool operator!=(const const_iterator& other) const
+	{
+		return !(*this==other);
+	}
+};
+
+
+// Gets an iterator to the first element
+template <typename T>
+auto lazy_stream<T>::begin() const -> const_iterator
+{
+	return const_iterator(this);
+}
+
+
+// Gets the end iterator, equal to any iterator past the last element
+template <typename T>
+auto lazy_stream<T>::end() const -> const_iterator
+{
+	return const_iterator();
+}
+
+
+// Input iterator consuming a stream: only its current node is kept alive
+//
+// Moving past an element drops the iterator's reference to its node, so
+// once nothing else refers to the stream the walk runs in constant memory.
+// A copy of the iterator keeps its own node, and the nodes after it, alive.
+//
+template <typename T>
+class lazy_stream<T>::consuming_iterator
+{
+	lazy_stream<T> stream_;
+
+public:
+
+	typedef std::input_iterator_tag iterator_category;
+	typedef T value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const T* pointer;
+	typedef const T& reference;
+
+	// End iterator
+	consuming_iterator() {}
+
+	// Iterator owning the only handle to stream
+	explicit consuming_iterator(lazy_stream<T>&& stream) :
+	stream_(std::move(stream)) {}
+
+	const T& operator*() const {return *stream_.head_ptr_;}
+
+	const T* operator->() const {return stream_.head_ptr_.get();}
+
+	consuming_iterator& operator++()
+	{
+		stream_=stream_.tail();
+		return *this;
+	}
+
+	consuming_iterator operator++(int)
+	{
+		consuming_iterator accu(*this);
+		++*this;
+		return accu;
+	}
+
+	bool operator==(const consuming_iterator& other) const
+	{
+		return stream_.head_ptr_==other.stream_.head_ptr_;
+	}
+
+	bool operator!=(const consuming_iterator& other) const
+	{
+		return !(*this==other);
+	}
+};
+
+
+// Single-use range of consuming iterators over a stream
+//
+// begin() hands the stream over to the iterator, so it may only be called once.
+//
+template <typename T>
+class lazy_stream<T>::consuming_range
+{
+	lazy_stream<T> stream_;
+
+public:
+
+	explicit consuming_range(lazy_stream<T>&& stream) :
+	stream_(std::move(stream)) {}
+
+	consuming_iterator begin() {return consuming_iterator(std::move(stream_));}
+
+	consuming_iterator end() const {return consuming_iterator();}
+};
+
+
+// Consumes the stream as a range, releasing each node once passed
+//
+// for(const T& value : std::move(stream).consume()) {...}
+//
+template <typename T>
+auto lazy_stream<T>::consume() && -> consuming_range
+{
+	return consuming_range(std::move(*this));
+}
+
+
+// Applies fn to every element, releasing each node once passed
+//
+// The stream is moved from. When no other copy of it is alive, the resident
+// memory stays bounded by the few nodes under evaluation, whatever the
+// length of the stream. Beware of the temporaries of the calling
+// full-expression: in from(0).map(f).for_each_consume(g), the temporary
+// from(0) lives, and retains every node after it, until the walk ends.
+//
+template <typename T>
+void lazy_stream<T>::for_each_consume(const std::function<void (const T&)>& fn) &&
+{
+	lazy_stream<T> temp(std::move(*this));
 
 	while(!temp.empty_)
 	{
-		accu=cons(*temp.head_ptr_, accu);
+		fn(*temp.head_ptr_);
 		temp=temp.tail();
 	}
-
-	return accu;
 }
 
 
-// Pours the stream into a std::list
+// Fold left reduction releasing each node once passed
+//
+// Same sequence as fold_left, in bounded memory as for_each_consume.
+//
 template <typename T>
-std::list<T> lazy_stream<T>::to_list() const
+template <typename U>
+U lazy_stream<T>::fold_left_consume(const U& start, const std::function<U (const U&, const T&)>& fold_fn) &&
 {
-	std::list<T> accu;;
-	lazy_stream<T> temp=*this;
+	U accu=start;
+	lazy_stream<T> temp(std::move(*this));
 
 	while(!temp.empty_)
 	{
-		accu.push_back(*temp.head_ptr_);
+		accu=fold_fn(accu, *temp.head_ptr_);
 		temp=temp.tail();
 	}
 
@@ -525,10 +1814,10 @@ lazy_stream<U> lazy_stream<T>::map(const std::function<U (const T&)>& map_fn) co
 	if(empty_)
 		return lazy_stream<U>();
 
-	const tail_type& tail_=tail();
+	lazy_stream<T> node(*this);
 
-	return lazy_stream<U>(map_fn(*head_ptr_), [tail_, map_fn]() -> lazy_stream<U> {
-		return tail_.map(map_fn);
+	return lazy_stream<U>(map_fn(*head_ptr_), [node, map_fn]() -> lazy_stream<U> {
+		return node.tail().map(map_fn);
 		});
 }
 
@@ -555,12 +1844,12 @@ std::function<U (const std::function<U (const U&, const T&)>&)> lazy_stream<T>::
 
 	return [temp1, start](const std::function<U (const U&, const T&)>& fold_fn) -> U {
 		U accu=start;
-		lazy_stream<T> temp2=temp1;
+		const lazy_stream<T>* temp2=&temp1;
 
-		while(!temp2.empty_)
+		while(!temp2->empty_)
 		{
-			accu=fold_fn(accu, *temp2.head_ptr_);
-			temp2=temp2.tail();
+			accu=fold_fn(accu, *temp2->head_ptr_);
+			temp2=&temp2->tail();
 		}
 
 		return accu;
@@ -568,6 +1857,39 @@ std::function<U (const std::function<U (const U&, const T&)>&)> lazy_stream<T>::
 }
 
 
+// Creates the stream of the successive fold left reductions, from start on
+//
+// Let start be a starting element of type U.
+// Let scan_fn be a function: (U, T) => U.
+//
+// scan_left creates the stream of the n+1 partial results
+// of fold_left on the n stream elements:
+//
+// start 						=> u_0;
+// scan_fn(u_0, elem_0) 		=> u_1;
+// scan_fn(u_1, elem_1) 		=> u_2;
+// ...							=> ...
+// scan_fn(u_n-1, elem_n-1) 	=> u_n
+//
+// Every u_i is computed once, when its node is first forced, from the
+// memoized u_i-1: running totals cost one scan_fn call per element, and
+// infinite streams have infinite scans.
+//
+template <typename T>
+template <typename U>
+lazy_stream<U> lazy_stream<T>::scan_left(const U& start, const std::function<U (const U&, const T&)>& scan_fn) const
+{
+	lazy_stream<T> node(*this);
+
+	return lazy_stream<U>(start, [node, start, scan_fn]() -> lazy_stream<U> {
+		if(node.empty_)
+			return lazy_stream<U>();
+
+		return node.tail().scan_left(scan_fn(start, *node.head_ptr_), scan_fn);
+		});
+}
+
+
 // Left reduction
 //
 // Let reduce_fn be a function: (U, T) => U.
@@ -590,7 +1912,613 @@ std::function<U (const std::function<U (const U&, const T&)>&)> lazy_stream<T>::
 	if(empty_)
 		throw std::range_error("Class: lazy_stream<>. Cannot reduce an empty stream.");
 
-	return tail().fold_left<U>(*head_ptr_);
+	return tail().template fold_left<U>(*head_ptr_);
+}
+
+
+// Fold left reduction run on chunks in parallel
+//
+// The calling thread walks the stream and cuts it into chunks of chunk
+// elements, which worker threads fold with fold_fn, each chunk starting
+// from start. The chunk partials are then merged with combine_fn:
+//
+// ordered:		combine_fn(...combine_fn(combine_fn(p_0, p_1), p_2)..., p_k)
+// unordered:	each worker merges its own partials as it goes and the
+//				worker partials are merged at the end, in no given order
+//
+// So start must be an identity of combine_fn, and combine_fn must be
+// associative (ordered) or associative and commutative (unordered) for the
+// result to equal fold_left(start)(fold_fn). On an empty stream the result
+// is start.
+//
+template <typename T>
+template <typename U>
+U lazy_stream<T>::parallel_fold(
+	const U& start,
+	const std::function<U (const U&, const T&)>& fold_fn,
+	const std::function<U (const U&, const U&)>& combine_fn,
+	size_t chunk,
+	parallel_order order) const
+{
+	if(empty_)
+		return start;
+
+	return parallel_fold_chunks<U>([&start, &fold_fn](const std::vector<T>& elements) -> U {
+		U accu=start;
+
+		for(const T& element : elements)
+			accu=fold_fn(accu, element);
+
+		return accu;
+		}, combine_fn, chunk, order);
+}
+
+
+// Left reduction run on chunks in parallel
+//
+// As parallel_fold, but each chunk is reduced starting from its own first
+// element, so no identity is needed. Observe that T must be convertible to U.
+//
+template <typename T>
+template <typename U>
+U lazy_stream<T>::parallel_reduce(
+	const std::function<U (const U&, const T&)>& reduce_fn,
+	const std::function<U (const U&, const U&)>& combine_fn,
+	size_t chunk,
+	parallel_order order) const
+{
+	if(empty_)
+		throw std::range_error("Class: lazy_stream<>. Cannot reduce an empty stream.");
+
+	return parallel_fold_chunks<U>([&reduce_fn](const std::vector<T>& elements) -> U {
+		U accu=elements.front();
+
+		for(size_t i=1; i<elements.size(); ++i)
+			accu=reduce_fn(accu, elements[i]);
+
+		return accu;
+		}, combine_fn, chunk, order);
+}
+
+
+// Folds the stream chunk by chunk on worker threads (private)
+//
+// chunk_fn folds one non-empty chunk into a partial. At most two chunks per
+// worker are queued, so the producer never runs far ahead of the workers.
+//
+template <typename T>
+template <typename U, typename Chunk_Fn>
+U lazy_stream<T>::parallel_fold_chunks(
+	const Chunk_Fn& chunk_fn,
+	const std::function<U (const U&, const U&)>& combine_fn,
+	size_t chunk,
+	parallel_order order) const
+{
+	if(chunk<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Chunk size must be positive.");
+
+	struct task_type
+	{
+		std::vector<T> elements_;
+		std::unique_ptr<std::promise<U>> result_ptr_;	// Ordered mode only
+	};
+
+	const size_t workers=std::max<size_t>(1, std::thread::hardware_concurrency());
+	const size_t max_queued=2*workers;
+
+	std::mutex mutex;
+	std::condition_variable task_ready;
+	std::condition_variable slot_free;
+	std::deque<task_type> tasks;
+	bool closed=false;
+
+	// Unordered mode: one partial per worker and the first error raised
+	std::vector<std::unique_ptr<U>> partials(workers);
+	std::exception_ptr error;
+
+	auto work=[&](size_t id) {
+		for(;;)
+		{
+			task_type task;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				task_ready.wait(lock, [&](){return closed || !tasks.empty();});
+
+				if(tasks.empty())
+					return;
+
+				task=std::move(tasks.front());
+				tasks.pop_front();
+			}
+
+			slot_free.notify_one();
+
+			try
+			{
+				U partial=chunk_fn(task.elements_);
+
+				if(task.result_ptr_)
+					task.result_ptr_->set_value(std::move(partial));
+				else if(partials[id])
+					*partials[id]=combine_fn(*partials[id], partial);
+				else
+					partials[id].reset(new U(std::move(partial)));
+			}
+			catch(...)
+			{
+				if(task.result_ptr_)
+					task.result_ptr_->set_exception(std::current_exception());
+				else
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+
+					if(!error)
+						error=std::current_exception();
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for(size_t id=0; id<workers; ++id)
+		threads.emplace_back(work, id);
+
+	auto close=[&]() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed=true;
+		}
+
+		task_ready.notify_all();
+
+		for(std::thread& thread : threads)
+			thread.join();
+	};
+
+	// Ordered mode: partials pending in stream order
+	std::deque<std::future<U>> pending;
+	std::unique_ptr<U> accu;
+
+	auto merge_front=[&]() {
+		U partial=pending.front().get();
+		pending.pop_front();
+
+		if(accu)
+			*accu=combine_fn(*accu, partial);
+		else
+			accu.reset(new U(std::move(partial)));
+	};
+
+	try
+	{
+		const lazy_stream<T>* temp=this;
+
+		while(!temp->empty_)
+		{
+			task_type task;
+			task.elements_.reserve(chunk);
+
+			for(; !temp->empty_ && task.elements_.size()<chunk; temp=&temp->tail())
+				task.elements_.push_back(*temp->head_ptr_);
+
+			if(order==ordered)
+			{
+				task.result_ptr_.reset(new std::promise<U>());
+				pending.push_back(task.result_ptr_->get_future());
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				slot_free.wait(lock, [&](){return tasks.size()<max_queued;});
+				tasks.push_back(std::move(task));
+			}
+
+			task_ready.notify_one();
+
+			while(pending.size()>max_queued)
+				merge_front();
+		}
+
+		while(!pending.empty())
+			merge_front();
+	}
+	catch(...)
+	{
+		close();
+		throw;
+	}
+
+	close();
+
+	if(order==ordered)
+		return std::move(*accu);
+
+	if(error)
+		std::rethrow_exception(error);
+
+	for(std::unique_ptr<U>& partial : partials)
+		if(partial)
+		{
+			if(accu)
+				*accu=combine_fn(*accu, *partial);
+			else
+				accu=std::move(partial);
+		}
+
+	return std::move(*accu);
+}
+
+
+// Creates a stream whose elements are evaluated up to n ahead on a background thread
+//
+// A background thread walks this stream and pushes its elements into a
+// ring buffer of n slots, blocking while the buffer is full, so generation
+// overlaps with the consumption of the returned stream. The returned stream
+// is an ordinary lazy stream: its first element is awaited here and each
+// following one when its tail is forced. An exception raised while walking
+// this stream is rethrown when the consumer reaches it.
+//
+// Dropping every copy of the returned stream cancels the thread, which
+// stops after the element it is generating, if any. This stream must not
+// be forced from other threads meanwhile.
+//
+template <typename T>
+lazy_stream<T> lazy_stream<T>::prefetch(size_t n) const
+{
+	if(n<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Prefetch size must be positive.");
+
+	if(empty_)
+		return lazy_stream<T>();
+
+	std::shared_ptr<prefetch_state_type> state_ptr=std::make_shared<prefetch_state_type>(n);
+	prefetch_state_type* state=state_ptr.get();	// Outlived by the thread: see the destructor
+	lazy_stream<T> source=*this;
+
+	// The source is moved out of the closure, which the thread keeps until it
+	// exits: only the node under the cursor stays alive, not the whole walk.
+	state->thread_=std::thread([state, source]() mutable {
+		try
+		{
+			lazy_stream<T> temp=std::move(source);
+
+			while(!temp.empty_)
+			{
+				{
+					std::unique_lock<std::mutex> lock(state->mutex_);
+					state->not_full_.wait(lock, [state](){
+						return state->cancelled_ || state->count_<state->ring_.size();
+						});
+
+					if(state->cancelled_)
+						return;
+
+					state->ring_[(state->first_+state->count_)%state->ring_.size()]=temp.head_ptr_;
+					++state->count_;
+				}
+
+				state->not_empty_.notify_one();
+				temp=temp.tail();
+			}
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock(state->mutex_);
+			state->error_=std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex_);
+			state->done_=true;
+		}
+
+		state->not_empty_.notify_one();
+		});
+
+	return prefetch_pull(state_ptr);
+}
+
+
+// Cancels and joins the prefetching thread
+template <typename T>
+lazy_stream<T>::prefetch_state_type::~prefetch_state_type()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cancelled_=true;
+	}
+
+	not_full_.notify_one();
+
+	if(thread_.joinable())
+		thread_.join();
+}
+
+
+// Pops the next prefetched element into a stream (private)
+template <typename T>
+lazy_stream<T> lazy_stream<T>::prefetch_pull(const std::shared_ptr<prefetch_state_type>& state_ptr)
+{
+	prefetch_state_type& state=*state_ptr;
+	head_ptr_type head_ptr;
+
+	{
+		std::unique_lock<std::mutex> lock(state.mutex_);
+		state.not_empty_.wait(lock, [&state](){return state.done_ || state.count_>0;});
+
+		if(state.count_<1)
+		{
+			if(state.error_)
+				std::rethrow_exception(state.error_);
+
+			return lazy_stream<T>();
+		}
+
+		head_ptr=std::move(state.ring_[state.first_]);
+		state.first_=(state.first_+1)%state.ring_.size();
+		--state.count_;
+	}
+
+	state.not_full_.notify_one();
+
+	return from_shared(std::move(head_ptr), [state_ptr]() -> lazy_stream<T> {
+		return lazy_stream<T>::prefetch_pull(state_ptr);
+		});
+}
+
+
+// Splits the stream into k substreams that can be consumed from k threads concurrently
+//
+// round_robin deals chunks of chunk elements to the substreams in turn, and
+// hashed sends every element to substream std::hash<T>()(element)%k (see
+// partition_by for other keys). Either way the substreams pull from a single
+// shared cursor on this stream: a consumer that runs out of elements reads
+// the next chunk under the source lock, deals it out and takes the queue
+// lock once per chunk, never per element. The elements of this stream are
+// thus forced serially, one chunk at a time; the work done on the
+// substreams runs in parallel. The first element of every substream is
+// read here.
+//
+// The queues are not bounded: the chunks dealt to a substream wait in its
+// queue until it is read, so a substream that lags behind holds its whole
+// share of what the others have read meanwhile. With hashed, or
+// partition_by, a substream left unread while the others are drained ends
+// up buffering every element of the source that hashes to it: the whole
+// source if all the keys do. Read the substreams concurrently to bound the
+// memory held. Blocking the reader of a full queue instead would deadlock a
+// thread that drains the substreams one after another.
+//
+// contiguous splits a finite stream into k ranges of consecutive elements
+// whose sizes differ by one at most. The whole stream is memoized here,
+// except for the closed-form sequences, and the substreams share its nodes
+// with no locking.
+//
+// The substreams share their elements with this stream without copying
+// them, and each one keeps its order.
+//
+template <typename T>
+std::vector<lazy_stream<T>> lazy_stream<T>::partition(size_t k, partition_policy policy, size_t chunk) const
+{
+	if(k<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Partition count must be positive.");
+
+	if(chunk<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Chunk size must be positive.");
+
+	if(policy==hashed)
+	{
+		if(!lazy_stream_detail::hash_traits<T>::enabled)
+			throw std::invalid_argument("Class: lazy_stream<>. Elements not hashable: partition them by key.");
+
+		return partition_chunks(k, lazy_stream_detail::hash_traits<T>::hash, chunk);
+	}
+
+	if(policy==round_robin)
+		return partition_chunks(k, nullptr, chunk);
+
+	size_t n=size();
+	std::vector<lazy_stream<T>> accu;
+	const lazy_stream<T>* position=this;
+	size_t at=0;
+
+	accu.reserve(k);
+
+	for(size_t i=0; i<k; ++i)
+	{
+		size_t first=i*(n/k)+std::min(i, n%k);
+		size_t length=n/k+(i<n%k ? 1 : 0);
+
+		if(arithmetic_ptr_)
+			accu.push_back(drop(first).take(length));
+		else
+		{
+			for(; at<first; ++at)
+				position=&position->tail();
+
+			accu.push_back(position->take(length));
+		}
+	}
+
+	return accu;
+}
+
+
+// Splits the stream into k substreams by the hash of the key of each element
+//
+// Every element goes to substream std::hash<Key>()(key_fn(element))%k, so
+// equal keys end up in the same substream. Otherwise as partition(k, hashed,
+// chunk), unbounded queues included: a substream left unread buffers every
+// element whose key hashes to it.
+//
+template <typename T>
+template <typename Key>
+std::vector<lazy_stream<T>> lazy_stream<T>::partition_by(size_t k, const std::function<Key (const T&)>& key_fn,
+	size_t chunk) const
+{
+	if(k<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Partition count must be positive.");
+
+	if(chunk<1)
+		throw std::invalid_argument("Class: lazy_stream<>. Chunk size must be positive.");
+
+	return partition_chunks(k, [key_fn](const T& value){return std::hash<Key>()(key_fn(value));}, chunk);
+}
+
+
+// Splits the stream into k substreams fed chunk by chunk from a shared source (private)
+template <typename T>
+std::vector<lazy_stream<T>> lazy_stream<T>::partition_chunks(size_t k,
+	const std::function<size_t (const T&)>& hash_fn, size_t chunk) const
+{
+	std::shared_ptr<partition_state_type> state_ptr=std::make_shared<partition_state_type>(*this, hash_fn, k, chunk);
+	std::vector<lazy_stream<T>> accu;
+
+	accu.reserve(k);
+
+	for(size_t i=0; i<k; ++i)
+	{
+		std::shared_ptr<partition_cursor_type> cursor_ptr=std::make_shared<partition_cursor_type>();
+
+		cursor_ptr->state_ptr_=state_ptr;
+		cursor_ptr->index_=i;
+		cursor_ptr->next_=0;
+		accu.push_back(partition_pull(cursor_ptr));
+	}
+
+	return accu;
+}
+
+
+// Gets the next chunk of substream index, reading the source if needed. False at the end (private)
+//
+// Chunks are read outside the queue lock, so the other consumers keep
+// popping theirs meanwhile. Whoever reads a chunk that ends the source, or
+// raises an exception, marks the partition done: every substream then
+// drains its queue and ends, or rethrows the exception.
+//
+template <typename T>
+bool lazy_stream<T>::partition_refill(partition_state_type& state, size_t index, std::vector<head_ptr_type>& chunk)
+{
+	for(;;)
+	{
+		{
+			std::lock_guard<std::mutex> lock(state.mutex_);
+
+			if(!state.queues_[index].empty())
+			{
+				chunk=std::move(state.queues_[index].front());
+				state.queues_[index].pop_front();
+				return true;
+			}
+
+			if(state.done_)
+			{
+				if(state.error_)
+					std::rethrow_exception(state.error_);
+
+				return false;
+			}
+		}
+
+		std::lock_guard<std::mutex> source_lock(state.source_mutex_);
+
+		{
+			// Another consumer may have read the source while this one waited
+			std::lock_guard<std::mutex> lock(state.mutex_);
+
+			if(!state.queues_[index].empty() || state.done_)
+				continue;
+		}
+
+		std::vector<head_ptr_type> elements;
+		std::exception_ptr error;
+
+		elements.reserve(state.chunk_);
+
+		try
+		{
+			for(; !state.source_.empty_ && elements.size()<state.chunk_; state.source_=state.source_.tail())
+				elements.push_back(state.source_.head_ptr_);
+		}
+		catch(...)
+		{
+			error=std::current_exception();
+		}
+
+		bool done=error || state.source_.empty_;
+		size_t k=state.queues_.size();
+		std::vector<std::pair<size_t, std::vector<head_ptr_type>>> dealt;
+
+		if(!state.hash_fn_)
+		{
+			dealt.emplace_back(state.next_, std::move(elements));
+			state.next_=(state.next_+1)%k;
+		}
+		else
+		{
+			for(head_ptr_type& element : elements)
+			{
+				size_t target=state.hash_fn_(*element)%k;
+
+				state.staging_[target].push_back(std::move(element));
+
+				if(state.staging_[target].size()>=state.chunk_)
+				{
+					dealt.emplace_back(target, std::move(state.staging_[target]));
+					state.staging_[target].clear();
+				}
+			}
+
+			// Partial chunks go out at the end, and to the consumer waiting for one
+			for(size_t i=0; i<k; ++i)
+				if((done || i==index) && !state.staging_[i].empty())
+				{
+					dealt.emplace_back(i, std::move(state.staging_[i]));
+					state.staging_[i].clear();
+				}
+		}
+
+		std::lock_guard<std::mutex> lock(state.mutex_);
+
+		for(std::pair<size_t, std::vector<head_ptr_type>>& next : dealt)
+			if(!next.second.empty())
+				state.queues_[next.first].push_back(std::move(next.second));
+
+		if(done)
+		{
+			state.done_=true;
+			state.error_=error;
+		}
+	}
+}
+
+
+// Creates the rest of a substream from its cursor (private)
+//
+// A substream forces its tails in order, one at a time, so its cursor is
+// never used concurrently.
+//
+template <typename T>
+lazy_stream<T> lazy_stream<T>::partition_pull(const std::shared_ptr<partition_cursor_type>& cursor_ptr)
+{
+	partition_cursor_type& cursor=*cursor_ptr;
+
+	if(cursor.next_>=cursor.chunk_.size())
+	{
+		cursor.chunk_.clear();
+		cursor.next_=0;
+
+		if(!partition_refill(*cursor.state_ptr_, cursor.index_, cursor.chunk_))
+			return lazy_stream<T>();
+	}
+
+	head_ptr_type head_ptr=std::move(cursor.chunk_[cursor.next_++]);
+
+	return from_shared(std::move(head_ptr), [cursor_ptr]() -> lazy_stream<T> {
+		return lazy_stream<T>::partition_pull(cursor_ptr);
+		});
 }
 
 
@@ -602,30 +2530,29 @@ lazy_stream<std::pair<T, U>> lazy_stream<T>::zip(const lazy_stream<U>& other) co
 	if(empty_ || other.empty_)
 		return lazy_stream<std::pair<T, U>>();
 
-	const tail_type& tail_=tail();
-	const tail_type& other_tail_=other.tail();
+	lazy_stream<T> node(*this);
 
 	return lazy_stream<std::pair<T, U>>(
 				std::pair<T, U>(*head_ptr_, *other.head_ptr_),
-				[tail_, other_tail_](){
-					return tail_.zip<U>(other_tail_);
+				[node, other](){
+					return node.tail().template zip<U>(other.tail());
 					});
 }
 
 
 // Creates a pair of streams by unzipping the pair elements in other
+//
+// Both streams are lazy maps over other and share its memoized nodes.
+//
 template <typename T, typename U>
 std::pair<lazy_stream<T>, lazy_stream<U>> unzip(const lazy_stream<std::pair<T, U>>& other)
 {
-	if(other.empty())
-		return std::pair<lazy_stream<T>, lazy_stream<U>>();
-
-	std::pair<T, U> head=*other.head_ptr_;
-	std::pair<lazy_stream<T>, lazy_stream<U>> tail=unzip(other.tail());
+	std::function<T (const std::pair<T, U>&)> first_fn=[](const std::pair<T, U>& value){return value.first;};
+	std::function<U (const std::pair<T, U>&)> second_fn=[](const std::pair<T, U>& value){return value.second;};
 
 	return std::pair<lazy_stream<T>, lazy_stream<U>>(
-			cons(head.first, tail.first),
-			cons(head.second, tail.second)
+			other.template map<T>(first_fn),
+			other.template map<U>(second_fn)
 			);
 }
 
@@ -646,4 +2573,19 @@ lazy_stream<T> operator&(const T& value, const lazy_stream<T>& other)
 }
 
 
+#if __cplusplus>=202002L
+
+#include <ranges>
+
+// size() walks the stream, and never returns on an infinite one: std::ranges
+// must not take lazy_stream<> for a sized range.
+namespace std::ranges
+{
+	template <typename T>
+	inline constexpr bool disable_sized_range<lazy_stream<T>> = true;
+}
+
+#endif
+
+
 #endif
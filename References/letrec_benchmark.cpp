@@ -0,0 +1,84 @@
+// ---------------------------------------------------------
+// - File: letrec_benchmark                                -
+// - Self-referential lazy_stream<> definitions: linear    -
+// - time and no leaked nodes                              -
+// ---------------------------------------------------------
+
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// A term modulo 2^64 that counts its live instances, so that leaked nodes show.
+struct term
+{
+	static long live;
+
+	unsigned long value_;
+
+	term(unsigned long value=0) : value_(value) {++live;}
+	term(const term& other) : value_(other.value_) {++live;}
+	~term() {--live;}
+
+	term& operator=(const term& other) {value_=other.value_; return *this;}
+};
+
+long term::live=0;
+
+
+// fibs = 0 : 1 : zipWith (+) fibs (tail fibs), modulo 2^64.
+lazy_stream<term> fibs()
+{
+	std::function<term (const std::pair<term, term>&)> sum=
+		[](const std::pair<term, term>& pair){return term(pair.first.value_+pair.second.value_);};
+
+	return lazy_stream<term>::letrec({0, 1}, [sum](const lazy_stream<term>& self){
+		return self.zip(self.tail()).map(sum);
+		});
+}
+
+
+int main(int argn, char *argc[])
+{
+	std::cout << std::fixed << std::setprecision(3);
+
+	for(long n=10000; n<=1000000; n*=10)
+	{
+		long live_0=term::live;
+		unsigned long last=0;
+
+		double ms=time_ms([&](){
+			lazy_stream<term> stream=fibs();
+
+			last=stream.get(n-1).value_;
+			});
+
+		// The same term computed iteratively
+		unsigned long a=0;
+		unsigned long b=1;
+
+		for(long i=0; i<n-1; ++i)
+		{
+			unsigned long c=a+b;
+			a=b;
+			b=c;
+		}
+
+		if(last!=a)
+			throw std::logic_error("Unexpected term.");
+
+		std::cout << "fibs(" << std::setw(7) << n << "): " << std::setw(9) << ms << "ms, "
+					<< std::setw(7) << 1e6*ms/n << "ns/term, "
+					<< term::live-live_0 << " terms left" << std::endl;
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread letrec_benchmark.cpp -o letrec_benchmark
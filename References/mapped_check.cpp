@@ -0,0 +1,178 @@
+// ---------------------------------------------------------
+// - File: mapped_check                                    -
+// - mapped_lines and mapped_records against std::getline  -
+// - and std::istream::read (POSIX)                        -
+// ---------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include "mapped_stream.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// Fails unless test throws an E.
+template <typename E>
+void expect_throw(const std::function<void ()>& test, const char* what)
+{
+	try
+	{
+		test();
+	}
+	catch(const E&)
+	{
+		return;
+	}
+	catch(...)
+	{
+	}
+
+	expect(false, what);
+}
+
+
+// Writes contents to a new temporary file and gets its path.
+std::string temporary_file(const std::string& contents)
+{
+	char path[]="/tmp/mapped_check_XXXXXX";
+	int fd=::mkstemp(path);
+
+	expect(fd>=0, "temporary file");
+	::close(fd);
+
+	std::ofstream(path, std::ios::binary) << contents;
+
+	return path;
+}
+
+
+// The lines of the file at path, read with std::getline.
+std::vector<std::string> read_lines(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<std::string> accu;
+
+	for(std::string line; std::getline(file, line);)
+		accu.push_back(line);
+
+	return accu;
+}
+
+
+// The record_size bytes records of the file at path, read with std::istream::read.
+std::vector<std::string> read_records(const std::string& path, size_t record_size)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<std::string> accu;
+	std::string record(record_size, '\0');
+
+	while(file.read(&record[0], record_size))
+		accu.push_back(record);
+
+	return accu;
+}
+
+
+// Are the elements of stream those of expected, in order?
+bool same(lazy_stream<std::string_view> stream, const std::vector<std::string>& expected)
+{
+	size_t i=0;
+
+	for(std::string_view view : std::move(stream).consume())
+		if(i>=expected.size() || view!=expected[i++])
+			return false;
+
+	return i==expected.size();
+}
+
+
+int main()
+{
+	std::string big;
+
+	for(int i=0; i<100000; ++i)
+		big+="line "+std::to_string(i)+(i%7==0 ? "\n\n" : "\n");
+
+	// Empty file, blank lines, with and without a final '\n'
+	const std::vector<std::string> texts={"", "\n", "\n\n", "one", "one\n", "one\ntwo", "one\n\ntwo\n", "\none\n", big};
+
+	for(const std::string& text : texts)
+	{
+		std::string path=temporary_file(text);
+
+		expect(same(mapped_lines(path), read_lines(path)), "mapped_lines");
+
+		std::remove(path.c_str());
+	}
+
+	// Records: none, one, many, and record sizes the file size is a multiple of
+	const std::vector<std::pair<std::string, size_t>> records={
+		{"", 1}, {"", 16}, {"abcd", 4}, {"abcdefgh", 2}, {"abcdefgh", 1}, {big, big.size()}, {big.substr(0, 160000), 16}};
+
+	for(const std::pair<std::string, size_t>& record : records)
+	{
+		std::string path=temporary_file(record.first);
+
+		expect(same(mapped_records(path, record.second), read_records(path, record.second)), "mapped_records");
+
+		std::remove(path.c_str());
+	}
+
+	// A file that is not a whole number of records
+	{
+		std::string path=temporary_file("abcdefghi");
+
+		expect_throw<std::runtime_error>([&](){mapped_records(path, 4);}, "truncated record");
+		expect_throw<std::runtime_error>([&](){mapped_records(path, 10);}, "record longer than the file");
+		expect_throw<std::invalid_argument>([&](){mapped_records(path, 0);}, "empty record");
+
+		std::remove(path.c_str());
+	}
+
+	// A missing file
+	{
+		std::string path=temporary_file("");
+
+		std::remove(path.c_str());
+
+		expect_throw<std::runtime_error>([&](){mapped_lines(path);}, "missing file, lines");
+		expect_throw<std::runtime_error>([&](){mapped_records(path, 4);}, "missing file, records");
+	}
+
+	// The stream keeps the mapping alive once the file is removed
+	{
+		std::string path=temporary_file(big);
+		lazy_stream<std::string_view> lines=mapped_lines(path);
+		std::vector<std::string> expected=read_lines(path);
+
+		std::remove(path.c_str());
+
+		expect(same(lines, expected), "mapped_lines of a removed file");
+		expect(lines.get(expected.size()-1)==expected.back(), "held mapped_lines");
+	}
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++17 -O2 -pthread mapped_check.cpp -o mapped_check
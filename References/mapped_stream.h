@@ -0,0 +1,195 @@
+// ---------------------------------------------------------
+// - Memory-mapped file sources for lazy_stream<>          -
+// - (POSIX, C++17)                                        -
+// ---------------------------------------------------------
+
+
+// mapped_lines and mapped_records map a whole file read-only and stream its
+// newline-delimited lines or its fixed-size binary records as
+// std::string_view elements pointing straight into the mapping: the bytes
+// are never copied. The kernel is told the mapping will be read
+// sequentially.
+//
+// Every stream node shares the ownership of the mapping through its head
+// pointer, so the views stay valid for as long as any node of the stream is
+// alive. A view copied out of the stream does not keep the mapping alive.
+
+
+#ifndef MAPPED_STREAM_H
+#define MAPPED_STREAM_H
+
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lazy_stream.h"
+
+
+// Read-only memory mapping of a whole file
+class mapped_file
+{
+	const char* data_;
+	size_t size_;
+
+public:
+
+	// Maps the file at path
+	explicit mapped_file(const std::string& path);
+
+	mapped_file(const mapped_file&)=delete;
+	mapped_file& operator=(const mapped_file&)=delete;
+
+	// Unmaps the file
+	~mapped_file();
+
+	// Gets the first mapped byte
+	const char* data() const {return data_;}
+
+	// Gets the number of mapped bytes
+	size_t size() const {return size_;}
+};
+
+
+namespace mapped_stream_detail
+{
+
+// An element and the mapping it points into
+struct view_holder
+{
+	std::string_view view_;
+	std::shared_ptr<const mapped_file> file_ptr_;
+};
+
+// Creates a node whose head is view, keeping the mapping alive
+template <typename Tail_Gen>
+lazy_stream<std::string_view> make_node(
+	std::string_view view,
+	const std::shared_ptr<const mapped_file>& file_ptr,
+	Tail_Gen&& tail_gen)
+{
+	std::shared_ptr<view_holder> holder_ptr=std::make_shared<view_holder>(view_holder{view, file_ptr});
+
+	return lazy_stream<std::string_view>::from_shared(
+		std::shared_ptr<std::string_view>(holder_ptr, &holder_ptr->view_),
+		std::forward<Tail_Gen>(tail_gen));
+}
+
+// Streams the lines starting at offset
+inline lazy_stream<std::string_view> lines_from(const std::shared_ptr<const mapped_file>& file_ptr, size_t offset)
+{
+	if(offset>=file_ptr->size())
+		return lazy_stream<std::string_view>();
+
+	const char* begin=file_ptr->data()+offset;
+	const char* end=static_cast<const char*>(std::memchr(begin, '\n', file_ptr->size()-offset));
+	size_t length=end ? size_t(end-begin) : file_ptr->size()-offset;
+
+	return make_node(std::string_view(begin, length), file_ptr, [file_ptr, offset, length]() {
+		return lines_from(file_ptr, offset+length+1);
+		});
+}
+
+// Streams the records of record_size bytes starting at offset
+inline lazy_stream<std::string_view> records_from(
+	const std::shared_ptr<const mapped_file>& file_ptr,
+	size_t offset,
+	size_t record_size)
+{
+	if(offset+record_size>file_ptr->size())
+		return lazy_stream<std::string_view>();
+
+	return make_node(std::string_view(file_ptr->data()+offset, record_size), file_ptr,
+		[file_ptr, offset, record_size]() {
+			return records_from(file_ptr, offset+record_size, record_size);
+			});
+}
+
+}	// namespace mapped_stream_detail
+
+
+// Maps the file at path
+inline mapped_file::mapped_file(const std::string& path) :
+data_(nullptr),
+size_(0)
+{
+	int fd=::open(path.c_str(), O_RDONLY);
+
+	if(fd<0)
+		throw std::runtime_error("Class: mapped_file. Cannot open "+path+": "+std::strerror(errno));
+
+	struct stat info;
+
+	if(::fstat(fd, &info)<0)
+	{
+		int error=errno;
+		::close(fd);
+		throw std::runtime_error("Class: mapped_file. Cannot stat "+path+": "+std::strerror(error));
+	}
+
+	size_=size_t(info.st_size);
+
+	if(size_>0)	// An empty file cannot be mapped
+	{
+		void* data=::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if(data==MAP_FAILED)
+		{
+			int error=errno;
+			::close(fd);
+			throw std::runtime_error("Class: mapped_file. Cannot map "+path+": "+std::strerror(error));
+		}
+
+		::madvise(data, size_, MADV_SEQUENTIAL);
+		data_=static_cast<const char*>(data);
+	}
+
+	::close(fd);	// The mapping outlives the descriptor
+}
+
+
+// Unmaps the file
+inline mapped_file::~mapped_file()
+{
+	if(data_)
+		::munmap(const_cast<char*>(data_), size_);
+}
+
+
+// Creates the stream of the newline-delimited lines of the file at path
+//
+// Lines do not include their '\n'. A final line without '\n' is kept.
+//
+inline lazy_stream<std::string_view> mapped_lines(const std::string& path)
+{
+	return mapped_stream_detail::lines_from(std::make_shared<const mapped_file>(path), 0);
+}
+
+
+// Creates the stream of the record_size bytes records of the file at path
+//
+// The file size must be a multiple of record_size.
+//
+inline lazy_stream<std::string_view> mapped_records(const std::string& path, size_t record_size)
+{
+	if(record_size<1)
+		throw std::invalid_argument("Function: mapped_records. Record size must be positive.");
+
+	std::shared_ptr<const mapped_file> file_ptr=std::make_shared<const mapped_file>(path);
+
+	if(file_ptr->size()%record_size!=0)
+		throw std::runtime_error("Function: mapped_records. "+path+" holds a truncated record.");
+
+	return mapped_stream_detail::records_from(file_ptr, 0, record_size);
+}
+
+
+#endif
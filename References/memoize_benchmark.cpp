@@ -0,0 +1,101 @@
+// ---------------------------------------------------------
+// - File: memoize_benchmark                               -
+// - Memoized tails of lazy_stream<> class                 -
+// ---------------------------------------------------------
+
+
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// Number of times a predicate has been evaluated.
+static long predicate_calls=0;
+
+
+// get(n) on the filtered and mapped stream of sample.cpp, forced twice.
+void benchmark_get(int n)
+{
+	typedef std::pair<int, int> pair_type;
+
+	lazy_stream<pair_type> stream=lazy_stream<int>::from(3).filter(
+		[](int value){
+			++predicate_calls;
+			return value%4==0;
+			}).map<pair_type>(
+				[](int value){
+					return pair_type(value, value+1);
+					});
+
+	predicate_calls=0;
+	double first=time_ms([&stream, n](){stream.get(n);});
+	long first_calls=predicate_calls;
+
+	predicate_calls=0;
+	double second=time_ms([&stream, n](){stream.get(n);});
+	long second_calls=predicate_calls;
+
+	std::cout << "get(" << std::setw(6) << n << "): "
+				<< std::setw(9) << first << "ms (" << first_calls << " calls, "
+				<< 1e6*first/n << "ns/elem), again: "
+				<< std::setw(9) << second << "ms (" << second_calls << " calls)" << std::endl;
+}
+
+
+// First n prime numbers by the sieve of sample.cpp, poured twice.
+void benchmark_sieve(int n)
+{
+	std::function<lazy_stream<int> (const lazy_stream<int>&)> sieve=
+	[&sieve](const lazy_stream<int>& start){
+
+		int head=start.head();
+
+		lazy_stream<int> temp=start.filter([head](int value){
+			++predicate_calls;
+			return value%head>0;
+			});
+
+		return lazy_stream<int>(head, [&sieve, temp](){return sieve(temp);});
+	};
+
+	lazy_stream<int> prime_numbers=sieve(lazy_stream<int>::from(2));
+	std::list<int> prime_number_list;
+
+	predicate_calls=0;
+	double first=time_ms([&](){prime_number_list=prime_numbers.take(n).to_list();});
+	long first_calls=predicate_calls;
+
+	predicate_calls=0;
+	double second=time_ms([&](){prime_number_list=prime_numbers.take(n).to_list();});
+	long second_calls=predicate_calls;
+
+	std::cout << "sieve(" << std::setw(5) << n << "): "
+				<< std::setw(9) << first << "ms (" << first_calls << " calls), again: "
+				<< std::setw(9) << second << "ms (" << second_calls << " calls, "
+				<< 1e6*second/n << "ns/elem)" << std::endl;
+}
+
+
+int main()
+{
+	std::cout << std::fixed << std::setprecision(3);
+
+	// The first get(n) costs the same per element whatever n is, and a second
+	// traversal reuses the memoized nodes without running any predicate.
+	// The first sieve pass is trial division by every smaller prime; only its
+	// replays are a plain walk over memoized nodes.
+	for(int n=1000; n<=32000; n*=2)
+		benchmark_get(n);
+
+	std::cout << std::endl;
+
+	for(int n=250; n<=2000; n*=2)
+		benchmark_sieve(n);
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread memoize_benchmark.cpp -o memoize_benchmark
@@ -0,0 +1,114 @@
+// ---------------------------------------------------------
+// - File: memory_ceiling                                  -
+// - Walks a very long lazy_stream<> within a fixed RSS    -
+// - budget (Linux)                                        -
+// ---------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include "lazy_stream.h"
+
+
+// Resident set size of this process, in bytes.
+long resident_bytes()
+{
+	long pages=0;
+	long resident=0;
+
+	if(FILE* statm=std::fopen("/proc/self/statm", "r"))
+	{
+		if(std::fscanf(statm, "%ld %ld", &pages, &resident)!=2)
+			resident=0;
+
+		std::fclose(statm);
+	}
+
+	return resident*sysconf(_SC_PAGESIZE);
+}
+
+
+// Budget above the resident size at start.
+static const long budget=16L*1024*1024;
+
+static long baseline=0;
+static long peak=0;
+
+
+// Samples the resident size every 2^16 elements and fails over budget.
+void check(long index)
+{
+	if(index%(1L<<16)!=0)
+		return;
+
+	long resident=resident_bytes()-baseline;
+
+	if(resident>peak)
+		peak=resident;
+
+	if(resident>budget)
+	{
+		std::cout << "FAILED: " << resident/1024 << "KiB resident after "
+					<< index << " elements" << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// The first n even multiples of 3.
+//
+// Built apart because the temporaries of a full-expression live until its
+// end: a chain like from(0).map(f).for_each_consume(g) would keep the head
+// of from(0), and so every memoized node after it, alive during the walk.
+lazy_stream<long> pipeline(long n)
+{
+	std::function<long (const long&)> triple=[](const long& value){return value*3;};
+	std::function<bool (const long&)> even=[](const long& value){return value%2==0;};
+
+	return lazy_stream<long>::from(0).map(triple).filter(even).take(n);
+}
+
+
+int main(int argn, char *argc[])
+{
+	// The default runs in seconds, yet retaining its nodes would take
+	// ~800MiB, far over budget. Pass 1000000000 for the full walk, which
+	// takes minutes.
+	long n=argn>1 ? std::atol(argc[1]) : 1L<<22;
+
+	baseline=resident_bytes();
+
+	// for_each_consume over a mapped and filtered infinite stream.
+	long count=0;
+
+	pipeline(n).for_each_consume(
+		[&count](const long& value){
+			if(value!=6*count)
+				throw std::logic_error("Unexpected element.");
+
+			check(count++);
+			});
+
+	std::cout << "for_each_consume: " << count << " elements, peak "
+				<< peak/1024 << "KiB over baseline" << std::endl;
+
+	// A range-based for loop over consuming iterators.
+	count=0;
+	peak=0;
+
+	for(const long& value : lazy_stream<long>::range(0, n).consume())
+		check(value), ++count;
+
+	std::cout << "consume():        " << count << " elements, peak "
+				<< peak/1024 << "KiB over baseline" << std::endl;
+
+	std::cout << "OK: within " << budget/1024 << "KiB" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread memory_ceiling.cpp -o memory_ceiling
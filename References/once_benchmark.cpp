@@ -0,0 +1,95 @@
+// ---------------------------------------------------------
+// - File: once_benchmark                                  -
+// - Single-consumer pipelines: lazy_stream<>, whose nodes -
+// - are reference counted, against once_stream<>          -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+#include "once_stream.h"
+
+
+std::function<bool (const long&)> odd=[](const long& value){return value%2==1;};
+std::function<long (const long&)> triple=[](const long& value){return 3*value;};
+std::function<long (const long&, const long&)> sum=[](const long& accu, const long& value){return accu+value;};
+
+
+// from(0).filter(odd).map(triple).take(n), folded into a sum
+long lazy_pipeline(long n)
+{
+	return lazy_stream<long>::from(0).filter(odd).map(triple).take(n).fold_left_consume(0L, sum);
+}
+
+
+long once_pipeline(long n)
+{
+	return once_stream<long>::from(0).filter(odd).map(triple).take(n).fold_left(0L, sum);
+}
+
+
+// The same pipeline run on threads independent consumers at once.
+double concurrent_ms(long n, unsigned threads, const std::function<long (long)>& pipeline)
+{
+	return time_ms([&](){
+		std::vector<std::thread> workers;
+
+		for(unsigned i=0; i<threads; ++i)
+			workers.emplace_back([&](){
+				if(pipeline(n)!=3*n*n)
+					throw std::logic_error("Unexpected sum.");
+				});
+
+		for(std::thread& worker : workers)
+			worker.join();
+		});
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 1000000;
+	unsigned threads=std::max(2u, std::thread::hardware_concurrency());
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	long lazy_sum=0;
+	long once_sum=0;
+
+	double lazy_ms=time_ms([&](){lazy_sum=lazy_pipeline(n);});
+	double once_ms=time_ms([&](){once_sum=once_pipeline(n);});
+
+	// The sum of the first n odd numbers is n^2
+	if(lazy_sum!=3*n*n || once_sum!=3*n*n)
+		throw std::logic_error("Unexpected sum.");
+
+	std::cout << "1 consumer:  lazy_stream " << std::setw(9) << lazy_ms << "ms ("
+				<< std::setw(7) << 1e6*lazy_ms/n << "ns/elem), once_stream " << std::setw(9) << once_ms
+				<< "ms (" << std::setw(7) << 1e6*once_ms/n << "ns/elem)" << std::endl;
+
+	lazy_ms=concurrent_ms(n, threads, lazy_pipeline);
+	once_ms=concurrent_ms(n, threads, once_pipeline);
+
+	std::cout << threads << " consumers: lazy_stream " << std::setw(9) << lazy_ms
+				<< "ms, once_stream " << std::setw(9) << once_ms << "ms" << std::endl;
+
+	// share() when the elements are needed twice
+	lazy_stream<long> shared=once_stream<long>::from(0).filter(odd).map(triple).take(n).share();
+
+	if(shared.size()!=size_t(n) || shared.get(n-1)!=3*(2*n-1))
+		throw std::logic_error("Unexpected shared stream.");
+
+	std::cout << "share(): " << n << " elements, read twice" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread once_benchmark.cpp -o once_benchmark
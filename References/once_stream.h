@@ -0,0 +1,394 @@
+// ---------------------------------------------------------
+// - Class: once_stream<>                                  -
+// - Single-pass, move-only stream with unique ownership   -
+// ---------------------------------------------------------
+
+
+// Every copy of a lazy_stream<> and every step along it adjusts the atomic
+// reference counts of the shared nodes, even when a single consumer walks
+// the elements once. once_stream<> is the single-consumer alternative: it
+// owns the state of its pipeline outright, as one step function wrapping
+// the step functions of the stages before it (the stages of step_gen.h),
+// and elements are pulled through every stage with no shared pointer
+// involved.
+//
+// once_stream<> is move-only. Chaining an operator or materializing the
+// stream (fold_left, to_list,...) consumes it, so every element is seen
+// once. share() turns the rest of the stream into an ordinary memoized
+// lazy_stream<> when several consumers need it.
+//
+// T must be default constructible.
+
+
+#ifndef ONCE_STREAM_H
+#define ONCE_STREAM_H
+
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+#include "step_gen.h"
+
+
+template <typename T>
+class once_stream
+{
+	// Pulls the next element into its argument. Returns false at the end.
+	typedef std::function<bool (T&)> step_fn_type;
+
+	typedef std::function<bool (const T&)> predicate_fn_type;
+
+	template <typename U>
+	friend class once_stream;
+
+	step_fn_type step_;
+
+	// Takes the step function out of the stream, leaving it consumed (private)
+	step_fn_type release();
+
+	// Lazily pulls the rest of the stream into a lazy stream (private)
+	static lazy_stream<T> pull(const std::shared_ptr<step_fn_type>& step_ptr);
+
+public:
+
+	// Creates the stream: {n, n+1, n+2,...}
+	static once_stream<T> from(const T& n);
+
+	// Creates the stream: {n, n+step, n+2*step,...}
+	static once_stream<T> from(const T& n, const T& step);
+
+	// Creates the stream: [from..to)
+	static once_stream<T> range(const T& from, const T& to);
+
+	// Creates the stream: [from..to) with a step
+	static once_stream<T> range(const T& from, const T& to, const T& step);
+
+	// Creates the stream pulling its elements from step_fn, which returns false at the end
+	explicit once_stream(std::function<bool (T&)> step_fn) :
+	step_(std::move(step_fn)) {}
+
+	// Creates the stream of the elements of a lazy stream, releasing each node once passed
+	explicit once_stream(lazy_stream<T>&& stream);
+
+	// Move constructor
+	once_stream(once_stream<T>&& other) noexcept :
+	step_(other.release()) {}
+
+	// Move assignment operator
+	once_stream<T>& operator=(once_stream<T>&& other) noexcept
+	{
+		step_=other.release();
+		return *this;
+	}
+
+	once_stream(const once_stream<T>&)=delete;
+	once_stream<T>& operator=(const once_stream<T>&)=delete;
+
+	// Has the stream been consumed?
+	bool consumed() const {return !step_;}
+
+	// Pulls the next element into value. Returns false at the end.
+	bool next(T& value);
+
+	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+	once_stream<T> filter(const predicate_fn_type& filter_fn) &&;
+
+	// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+	once_stream<T> filter_not(const predicate_fn_type& filter_fn) &&;
+
+	// Creates the substream of the first n elements
+	once_stream<T> take(size_t n) &&;
+
+	// Creates the substream resulting from dropping the first n elements
+	once_stream<T> drop(size_t n) &&;
+
+	// Creates the substream whose head does not comply with drop_fn predicate
+	once_stream<T> drop_while(const predicate_fn_type& drop_fn) &&;
+
+	// Creates a stream by applying the map_fn map
+	template <typename U>
+	once_stream<U> map(const std::function<U (const T&)>& map_fn) &&;
+
+	// Fold left reduction
+	template <typename U>
+	U fold_left(const U& start, const std::function<U (const U&, const T&)>& fold_fn) &&;
+
+	// Applies fn to every element
+	void for_each(const std::function<void (const T&)>& fn) &&;
+
+	// Gets the number of elements in the stream
+	size_t size() &&;
+
+	// Pours the stream into a std::list
+	std::list<T> to_list() &&;
+
+	// Pours the stream into a std::vector, reserving size_hint elements
+	std::vector<T> to_vector(size_t size_hint=0) &&;
+
+	// Turns the rest of the stream into a lazy stream that can be shared
+	lazy_stream<T> share() &&;
+};
+
+
+// Creates the stream: {n, n+1, n+2,...}
+template <typename T>
+once_stream<T> once_stream<T>::from(const T& n)
+{
+	return from(n, T(1));
+}
+
+
+// Creates the stream: {n, n+step, n+2*step,...}
+template <typename T>
+once_stream<T> once_stream<T>::from(const T& n, const T& step)
+{
+	return once_stream<T>(step_gen_detail::from_gen<T>{n, step});
+}
+
+
+// Creates the stream: [from..to)
+template <typename T>
+once_stream<T> once_stream<T>::range(const T& from, const T& to)
+{
+	return range(from, to, to<from ? T(-1) : T(1));
+}
+
+
+// Creates the stream: [from..to) with a step
+template <typename T>
+once_stream<T> once_stream<T>::range(const T& from, const T& to, const T& step)
+{
+	return once_stream<T>(step_gen_detail::range_gen<T>{from, to, step});
+}
+
+
+// Creates the stream of the elements of a lazy stream, releasing each node once passed
+//
+// Only the node under the cursor is kept by the stream, as in
+// lazy_stream<>::for_each_consume.
+//
+template <typename T>
+once_stream<T>::once_stream(lazy_stream<T>&& stream) :
+step_(step_gen_detail::lazy_gen<T>{std::move(stream)}) {}
+
+
+// Takes the step function out of the stream, leaving it consumed (private)
+//
+// Swapping, unlike moving, guarantees that the stream is left empty.
+//
+template <typename T>
+auto once_stream<T>::release() -> step_fn_type
+{
+	step_fn_type accu;
+
+	accu.swap(step_);
+
+	return accu;
+}
+
+
+// Pulls the next element into value. Returns false at the end.
+template <typename T>
+bool once_stream<T>::next(T& value)
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return step_(value);
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+template <typename T>
+once_stream<T> once_stream<T>::filter(const predicate_fn_type& filter_fn) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return once_stream<T>(step_gen_detail::filter_gen<step_fn_type, predicate_fn_type, T>{release(), filter_fn});
+}
+
+
+// Creates a substream by selecting all the elements which do not satisfy the filter_fn predicate
+template <typename T>
+once_stream<T> once_stream<T>::filter_not(const predicate_fn_type& filter_fn) &&
+{
+	return std::move(*this).filter([filter_fn](const T& value){return !filter_fn(value);});
+}
+
+
+// Creates the substream of the first n elements
+template <typename T>
+once_stream<T> once_stream<T>::take(size_t n) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return once_stream<T>(step_gen_detail::take_gen<step_fn_type, T>{release(), n});
+}
+
+
+// Creates the substream resulting from dropping the first n elements
+template <typename T>
+once_stream<T> once_stream<T>::drop(size_t n) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return once_stream<T>(step_gen_detail::drop_gen<step_fn_type, T>{release(), n});
+}
+
+
+// Creates the substream whose head does not comply with drop_fn predicate
+template <typename T>
+once_stream<T> once_stream<T>::drop_while(const predicate_fn_type& drop_fn) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return once_stream<T>(step_gen_detail::drop_while_gen<step_fn_type, predicate_fn_type, T>{release(), drop_fn, true});
+}
+
+
+// Creates a stream by applying the map_fn map
+template <typename T>
+template <typename U>
+once_stream<U> once_stream<T>::map(const std::function<U (const T&)>& map_fn) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return once_stream<U>(step_gen_detail::map_gen<step_fn_type, std::function<U (const T&)>, T, U>{release(), map_fn, T()});
+}
+
+
+// Fold left reduction
+//
+// Same sequence as lazy_stream<>::fold_left.
+//
+template <typename T>
+template <typename U>
+U once_stream<T>::fold_left(const U& start, const std::function<U (const U&, const T&)>& fold_fn) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	step_fn_type step=release();
+	U accu=start;
+	T value;
+
+	while(step(value))
+		accu=fold_fn(accu, value);
+
+	return accu;
+}
+
+
+// Applies fn to every element
+template <typename T>
+void once_stream<T>::for_each(const std::function<void (const T&)>& fn) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	step_fn_type step=release();
+	T value;
+
+	while(step(value))
+		fn(value);
+}
+
+
+// Gets the number of elements in the stream
+template <typename T>
+size_t once_stream<T>::size() &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	step_fn_type step=release();
+	size_t accu=0;
+	T value;
+
+	while(step(value))
+		++accu;
+
+	return accu;
+}
+
+
+// Pours the stream into a std::list
+template <typename T>
+std::list<T> once_stream<T>::to_list() &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	step_fn_type step=release();
+	std::list<T> accu;
+	T value;
+
+	while(step(value))
+		accu.push_back(value);
+
+	return accu;
+}
+
+
+// Pours the stream into a std::vector, reserving size_hint elements
+template <typename T>
+std::vector<T> once_stream<T>::to_vector(size_t size_hint) &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	step_fn_type step=release();
+	std::vector<T> accu;
+	T value;
+
+	accu.reserve(size_hint);
+
+	while(step(value))
+		accu.push_back(value);
+
+	return accu;
+}
+
+
+// Turns the rest of the stream into a lazy stream that can be shared
+//
+// The step function moves to the nodes of the resulting stream, which share
+// it from then on. Since lazy_stream<> memoizes its tails, each element is
+// still pulled exactly once.
+//
+template <typename T>
+lazy_stream<T> once_stream<T>::share() &&
+{
+	if(!step_)
+		throw std::logic_error("Class: once_stream<>. Stream already consumed.");
+
+	return pull(std::make_shared<step_fn_type>(release()));
+}
+
+
+// Lazily pulls the rest of the stream into a lazy stream (private)
+template <typename T>
+lazy_stream<T> once_stream<T>::pull(const std::shared_ptr<step_fn_type>& step_ptr)
+{
+	T value;
+
+	if(!(*step_ptr)(value))
+		return lazy_stream<T>();
+
+	return lazy_stream<T>(std::move(value), [step_ptr]() -> lazy_stream<T> {
+		return once_stream<T>::pull(step_ptr);
+		});
+}
+
+
+#endif
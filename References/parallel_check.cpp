@@ -0,0 +1,131 @@
+// ---------------------------------------------------------
+// - File: parallel_check                                  -
+// - parallel_fold and parallel_reduce against fold_left   -
+// - and reduce_left                                       -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "lazy_stream.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// Fails unless test throws an E.
+template <typename E>
+void expect_throw(const std::function<void ()>& test, const char* what)
+{
+	try
+	{
+		test();
+	}
+	catch(const E&)
+	{
+		return;
+	}
+	catch(...)
+	{
+	}
+
+	expect(false, what);
+}
+
+
+// [0..n) through an identity map, so that no closed form is taken.
+lazy_stream<long> walked(long n)
+{
+	std::function<long (const long&)> identity=[](const long& value){return value;};
+
+	return lazy_stream<long>::range(0, n).map(identity);
+}
+
+
+int main()
+{
+	typedef lazy_stream<long> stream_type;
+
+	std::function<long (const long&, const long&)> add=[](const long& accu, const long& value){return accu+value;};
+	std::function<long (const long&, const long&)> greatest=
+		[](const long& accu, const long& value){return value>accu ? value : accu;};
+
+	// Concatenation is associative but not commutative: the ordered mode must keep stream order
+	std::function<std::string (const std::string&, const long&)> append=
+		[](const std::string& accu, const long& value){return accu+char('a'+value%26);};
+	std::function<std::string (const std::string&, const std::string&)> concatenate=
+		[](const std::string& left, const std::string& right){return left+right;};
+
+	// Empty streams, streams shorter than a chunk, whole chunks, and a final partial chunk
+	const long sizes[]={0, 1, 6, 7, 8, 100, 4095, 4096, 4097, 100003};
+	const size_t chunks[]={1, 7, 4096};
+
+	for(long n : sizes)
+		for(size_t chunk : chunks)
+		{
+			if(n>10000 && chunk<7)
+				continue;
+
+			stream_type stream=walked(n);
+			long sum=stream.fold_left<long>(0)(add);
+			std::string text=stream.fold_left<std::string>("")(append);
+
+			expect(stream.parallel_fold<long>(0, add, add, chunk)==sum, "ordered parallel_fold");
+			expect(stream.parallel_fold<long>(0, add, add, chunk, stream_type::unordered)==sum,
+				"unordered parallel_fold");
+			expect(stream.parallel_fold<std::string>("", append, concatenate, chunk)==text,
+				"ordered parallel_fold keeps stream order");
+
+			if(n==0)
+			{
+				expect_throw<std::range_error>([&](){stream.parallel_reduce<long>(add, add, chunk);},
+					"parallel_reduce of an empty stream");
+				continue;
+			}
+
+			long maximum=stream.reduce_left<long>()(greatest);
+
+			expect(stream.parallel_reduce<long>(add, add, chunk)==sum, "ordered parallel_reduce");
+			expect(stream.parallel_reduce<long>(add, add, chunk, stream_type::unordered)==sum,
+				"unordered parallel_reduce");
+			expect(stream.parallel_reduce<long>(greatest, greatest, chunk, stream_type::unordered)==maximum,
+				"unordered parallel_reduce, maximum");
+		}
+
+	// A closed-form range goes through the same chunks as a walked stream
+	expect(stream_type::range(0, 100000).parallel_fold<long>(0, add, add, 333)==walked(100000).fold_left<long>(0)(add),
+		"parallel_fold of a range");
+
+	expect_throw<std::invalid_argument>([&](){walked(10).parallel_fold<long>(0, add, add, 0);},
+		"parallel_fold with no chunk size");
+
+	// An error raised on a worker reaches the caller, in both modes
+	std::function<long (const long&, const long&)> failing=[](const long& accu, const long& value) -> long {
+		if(value==5000)
+			throw std::runtime_error("Failing element.");
+
+		return accu+value;
+		};
+
+	expect_throw<std::runtime_error>([&](){walked(10000).parallel_fold<long>(0, failing, add, 64);},
+		"ordered parallel_fold error");
+	expect_throw<std::runtime_error>([&](){walked(10000).parallel_fold<long>(0, failing, add, 64, stream_type::unordered);},
+		"unordered parallel_fold error");
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread parallel_check.cpp -o parallel_check
@@ -0,0 +1,403 @@
+// ---------------------------------------------------------
+// - Function: parallel_scan<>                             -
+// - Inclusive prefix scan of a std::vector<> on worker    -
+// - threads                                               -
+// ---------------------------------------------------------
+
+
+// parallel_scan(values, op) replaces every element of values by the
+// combination by op of the elements up to it: the std::vector<> matching
+// lazy_stream<>::scan_left, as std::inclusive_scan does for iterators.
+//
+// The vector is cut into one block per worker and scanned in two passes:
+// the workers first reduce their blocks to one total each, the first block
+// being scanned at once instead; the totals are then scanned in order into
+// the offset of every block, and the workers scan the other blocks from
+// their offsets. Each element is read twice and written once, and op must
+// be associative.
+//
+// On x86-64, when op is std::plus<T> and T a 32 or 64-bit arithmetic type,
+// the blocks are reduced and scanned in SSE2 registers, several elements
+// per instruction. The floating-point sums are then grouped differently
+// from a sequential scan and may differ from it in the last bits.
+
+
+#ifndef PARALLEL_SCAN_H
+#define PARALLEL_SCAN_H
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) && defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+
+namespace parallel_scan_detail
+{
+
+// Fewest elements per worker worth a thread of its own
+const size_t min_block_size=size_t(1)<<14;
+
+// Sums and prefix sums of the arithmetic types held by SSE2 registers
+//
+// lanes elements per register; a load, a log2(lanes)-step shift and add
+// and a broadcast of the last lane scan a register from the carry. Other
+// types have no vectorized form.
+template <typename T, typename Enable=void>
+struct simd_traits
+{
+	static const bool enabled=false;
+};
+
+#if defined(__SSE2__) && defined(__x86_64__)
+
+template <typename T>
+struct simd_traits<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T)==4>::type>
+{
+	static const bool enabled=true;
+	static const size_t lanes=4;
+
+	// Gets the sum of [first, first+n)
+	static T reduce(const T* first, size_t n)
+	{
+		__m128i accu=_mm_setzero_si128();
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+			accu=_mm_add_epi32(accu, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first+i)));
+
+		accu=_mm_add_epi32(accu, _mm_srli_si128(accu, 8));
+		accu=_mm_add_epi32(accu, _mm_srli_si128(accu, 4));
+
+		T sum=T(_mm_cvtsi128_si32(accu));
+
+		for(; i<n; ++i)
+			sum+=first[i];
+
+		return sum;
+	}
+
+	// Writes the prefix sums of [first, first+n), plus carry, to out
+	static void scan(const T* first, size_t n, T* out, T carry)
+	{
+		__m128i offset=_mm_set1_epi32(int32_t(carry));
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+		{
+			__m128i value=_mm_loadu_si128(reinterpret_cast<const __m128i*>(first+i));
+
+			value=_mm_add_epi32(value, _mm_slli_si128(value, 4));
+			value=_mm_add_epi32(value, _mm_slli_si128(value, 8));
+			value=_mm_add_epi32(value, offset);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out+i), value);
+			offset=_mm_shuffle_epi32(value, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+
+		carry=T(_mm_cvtsi128_si32(offset));
+
+		for(; i<n; ++i)
+			out[i]=carry+=first[i];
+	}
+};
+
+template <typename T>
+struct simd_traits<T, typename std::enable_if<std::is_integral<T>::value && sizeof(T)==8>::type>
+{
+	static const bool enabled=true;
+	static const size_t lanes=2;
+
+	// Gets the sum of [first, first+n)
+	static T reduce(const T* first, size_t n)
+	{
+		__m128i accu=_mm_setzero_si128();
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+			accu=_mm_add_epi64(accu, _mm_loadu_si128(reinterpret_cast<const __m128i*>(first+i)));
+
+		accu=_mm_add_epi64(accu, _mm_srli_si128(accu, 8));
+
+		T sum=T(_mm_cvtsi128_si64(accu));
+
+		for(; i<n; ++i)
+			sum+=first[i];
+
+		return sum;
+	}
+
+	// Writes the prefix sums of [first, first+n), plus carry, to out
+	static void scan(const T* first, size_t n, T* out, T carry)
+	{
+		__m128i offset=_mm_set1_epi64x(int64_t(carry));
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+		{
+			__m128i value=_mm_loadu_si128(reinterpret_cast<const __m128i*>(first+i));
+
+			value=_mm_add_epi64(value, _mm_slli_si128(value, 8));
+			value=_mm_add_epi64(value, offset);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out+i), value);
+			offset=_mm_unpackhi_epi64(value, value);
+		}
+
+		carry=T(_mm_cvtsi128_si64(offset));
+
+		for(; i<n; ++i)
+			out[i]=carry+=first[i];
+	}
+};
+
+template <>
+struct simd_traits<float>
+{
+	static const bool enabled=true;
+	static const size_t lanes=4;
+
+	// Gets the sum of [first, first+n)
+	static float reduce(const float* first, size_t n)
+	{
+		__m128 accu=_mm_setzero_ps();
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+			accu=_mm_add_ps(accu, _mm_loadu_ps(first+i));
+
+		accu=_mm_add_ps(accu, _mm_movehl_ps(accu, accu));
+		accu=_mm_add_ss(accu, _mm_shuffle_ps(accu, accu, _MM_SHUFFLE(1, 1, 1, 1)));
+
+		float sum=_mm_cvtss_f32(accu);
+
+		for(; i<n; ++i)
+			sum+=first[i];
+
+		return sum;
+	}
+
+	// Writes the prefix sums of [first, first+n), plus carry, to out
+	static void scan(const float* first, size_t n, float* out, float carry)
+	{
+		__m128 offset=_mm_set1_ps(carry);
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+		{
+			__m128 value=_mm_loadu_ps(first+i);
+
+			value=_mm_add_ps(value, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(value), 4)));
+			value=_mm_add_ps(value, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(value), 8)));
+			value=_mm_add_ps(value, offset);
+			_mm_storeu_ps(out+i, value);
+			offset=_mm_shuffle_ps(value, value, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+
+		carry=_mm_cvtss_f32(offset);
+
+		for(; i<n; ++i)
+			out[i]=carry+=first[i];
+	}
+};
+
+template <>
+struct simd_traits<double>
+{
+	static const bool enabled=true;
+	static const size_t lanes=2;
+
+	// Gets the sum of [first, first+n)
+	static double reduce(const double* first, size_t n)
+	{
+		__m128d accu=_mm_setzero_pd();
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+			accu=_mm_add_pd(accu, _mm_loadu_pd(first+i));
+
+		accu=_mm_add_sd(accu, _mm_unpackhi_pd(accu, accu));
+
+		double sum=_mm_cvtsd_f64(accu);
+
+		for(; i<n; ++i)
+			sum+=first[i];
+
+		return sum;
+	}
+
+	// Writes the prefix sums of [first, first+n), plus carry, to out
+	static void scan(const double* first, size_t n, double* out, double carry)
+	{
+		__m128d offset=_mm_set1_pd(carry);
+		size_t i=0;
+
+		for(; i+lanes<=n; i+=lanes)
+		{
+			__m128d value=_mm_loadu_pd(first+i);
+
+			value=_mm_add_pd(value, _mm_castsi128_pd(_mm_slli_si128(_mm_castpd_si128(value), 8)));
+			value=_mm_add_pd(value, offset);
+			_mm_storeu_pd(out+i, value);
+			offset=_mm_unpackhi_pd(value, value);
+		}
+
+		carry=_mm_cvtsd_f64(offset);
+
+		for(; i<n; ++i)
+			out[i]=carry+=first[i];
+	}
+};
+
+#endif
+
+// Reduces and scans the blocks of a parallel_scan, with any associative op
+template <typename T, typename Op, bool Simd=std::is_same<Op, std::plus<T>>::value && simd_traits<T>::enabled>
+struct block_traits
+{
+	// Gets the combination of [first, first+n), n positive
+	static T reduce(const T* first, size_t n, const Op& op)
+	{
+		T accu=first[0];
+
+		for(size_t i=1; i<n; ++i)
+			accu=op(accu, first[i]);
+
+		return accu;
+	}
+
+	// Scans [first, first+n) in place, after offset if not null
+	static void scan(T* first, size_t n, const T* offset, const Op& op)
+	{
+		if(n==0)
+			return;
+
+		T accu=offset ? op(*offset, first[0]) : first[0];
+
+		first[0]=accu;
+
+		for(size_t i=1; i<n; ++i)
+			first[i]=accu=op(accu, first[i]);
+	}
+};
+
+template <typename T, typename Op>
+struct block_traits<T, Op, true>
+{
+	// Gets the sum of [first, first+n)
+	static T reduce(const T* first, size_t n, const Op&)
+	{
+		return simd_traits<T>::reduce(first, n);
+	}
+
+	// Scans [first, first+n) in place, after offset if not null
+	static void scan(T* first, size_t n, const T* offset, const Op&)
+	{
+		simd_traits<T>::scan(first, n, first, offset ? *offset : T(0));
+	}
+};
+
+}	// namespace parallel_scan_detail
+
+
+// Creates the inclusive prefix scan of values by op, on up to threads workers
+//
+// values is taken by value: move a vector in to scan it in place. threads
+// 0 stands for std::thread::hardware_concurrency(), and fewer workers run
+// on small vectors, down to a plain sequential scan. An exception thrown
+// by op is rethrown once every worker is done.
+//
+template <typename T, typename Op=std::plus<T>>
+std::vector<T> parallel_scan(std::vector<T> values, const Op& op=Op(), size_t threads=0)
+{
+	typedef parallel_scan_detail::block_traits<T, Op> block_traits;
+
+	if(threads==0)
+		threads=std::max(1u, std::thread::hardware_concurrency());
+
+	size_t n=values.size();
+	size_t blocks=std::max(size_t(1), std::min(threads, n/parallel_scan_detail::min_block_size));
+	size_t block_size=(n+blocks-1)/blocks;
+	T* data=values.data();
+
+	if(blocks==1)
+	{
+		block_traits::scan(data, n, nullptr, op);
+		return values;
+	}
+
+	// Runs fn(block) for blocks [1, blocks) on workers and block 0 here
+	auto run=[&](const std::function<void (size_t)>& fn) {
+		std::vector<std::future<void>> workers;
+
+		for(size_t block=1; block<blocks; ++block)
+			workers.push_back(std::async(std::launch::async, fn, block));
+
+		std::exception_ptr error;
+
+		try
+		{
+			fn(0);
+		}
+		catch(...)
+		{
+			error=std::current_exception();
+		}
+
+		for(std::future<void>& worker : workers)
+			try
+			{
+				worker.get();
+			}
+			catch(...)
+			{
+				if(!error)
+					error=std::current_exception();
+			}
+
+		if(error)
+			std::rethrow_exception(error);
+	};
+
+	// Pass 1: the first block is scanned, the others but the last reduced
+	std::vector<T> totals(blocks, T());
+
+	run([&](size_t block) {
+		T* first=data+block*block_size;
+
+		if(block==0)
+			block_traits::scan(first, block_size, nullptr, op);
+		else if(block+1<blocks)
+			totals[block]=block_traits::reduce(first, block_size, op);
+		});
+
+	// The offset of block i is the scan up to the end of block i-1
+	totals[0]=data[block_size-1];
+
+	for(size_t block=1; block+1<blocks; ++block)
+		totals[block]=op(totals[block-1], totals[block]);
+
+	// Pass 2: the other blocks are scanned from their offsets
+	run([&](size_t block) {
+		if(block==0)
+			return;
+
+		size_t first=block*block_size;
+
+		block_traits::scan(data+first, std::min(n, first+block_size)-first, &totals[block-1], op);
+		});
+
+	return values;
+}
+
+
+#endif
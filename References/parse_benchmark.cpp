@@ -0,0 +1,125 @@
+// ---------------------------------------------------------
+// - File: parse_benchmark                                 -
+// - Throughput of bulk-parsed numeric sources against     -
+// - operator>> one element at a time (C++17)              -
+// ---------------------------------------------------------
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+#include "parsed_stream.h"
+
+
+// The numbers of in, pulled one at a time with operator>>
+template <typename T>
+lazy_stream<T> extracted_numbers(const std::shared_ptr<std::ifstream>& in)
+{
+	T value;
+
+	if(!(*in >> value))
+		return lazy_stream<T>();
+
+	return lazy_stream<T>(value, [in](){return extracted_numbers<T>(in);});
+}
+
+
+// Sums a stream, consuming it.
+template <typename T>
+T sum(lazy_stream<T>&& stream)
+{
+	return std::move(stream).template fold_left_consume<T>(T(0), [](const T& accu, const T& value){return accu+value;});
+}
+
+
+// Sums a stream of chunks, consuming it.
+template <typename T>
+T sum_chunks(lazy_stream<std::vector<T>>&& stream)
+{
+	T accu=T(0);
+
+	std::move(stream).for_each_consume([&accu](const std::vector<T>& chunk){
+		for(const T& value : chunk)
+			accu+=value;
+		});
+
+	return accu;
+}
+
+
+// Prints the throughput of the three sources over the file at path.
+template <typename T>
+void report(const char* name, const std::string& path, double megabytes)
+{
+	T extracted=T(0);
+	T parsed=T(0);
+	T chunked=T(0);
+
+	double extracted_ms=time_ms([&](){extracted=sum(extracted_numbers<T>(std::make_shared<std::ifstream>(path)));});
+	double parsed_ms=time_ms([&](){parsed=sum(parsed_numbers<T>(path));});
+	double chunked_ms=time_ms([&](){chunked=sum_chunks(parsed_chunks<T>(path));});
+
+	// Both parsers round correctly and the sums run in the same order
+	if(parsed!=extracted || chunked!=extracted)
+		throw std::logic_error("Parsed and extracted numbers disagree.");
+
+	std::cout << std::setw(6) << name << ": operator>> " << std::setw(8) << 1e3*megabytes/extracted_ms
+				<< " MB/s, parsed_numbers " << std::setw(8) << 1e3*megabytes/parsed_ms
+				<< " MB/s, parsed_chunks " << std::setw(8) << 1e3*megabytes/chunked_ms << " MB/s" << std::endl;
+}
+
+
+// Writes n numbers drawn by draw to path. Returns the size in MB.
+double write_file(const std::string& path, long n, const std::function<void (std::ostream&)>& draw)
+{
+	std::ofstream out(path);
+
+	for(long i=0; i<n; ++i)
+	{
+		draw(out);
+		out << (i%10==9 ? '\n' : ' ');
+	}
+
+	return double(out.tellp())/1e6;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 2000000;
+	std::string path="parse_benchmark.txt";
+	std::mt19937_64 engine(1);
+
+	std::cout << std::fixed << std::setprecision(1);
+
+	double megabytes=write_file(path, n, [&engine](std::ostream& out){
+		out << long(engine()>>20)-(1L<<43);
+		});
+
+	std::cout << n << " numbers per file" << std::endl;
+	report<long>("long", path, megabytes);
+
+	std::uniform_real_distribution<double> distribution(-1e6, 1e6);
+
+	megabytes=write_file(path, n, [&engine, &distribution](std::ostream& out){
+		out << std::setprecision(17) << distribution(engine);
+		});
+
+	report<double>("double", path, megabytes);
+
+	std::remove(path.c_str());
+
+	return 0;
+}
+
+// compile this> g++ -std=c++17 -O2 -pthread parse_benchmark.cpp -o parse_benchmark
@@ -0,0 +1,303 @@
+// ---------------------------------------------------------
+// - Bulk-parsed numeric sources for lazy_stream<>         -
+// - (C++17)                                               -
+// ---------------------------------------------------------
+
+
+// parsed_numbers and parsed_chunks stream the whitespace-separated numbers
+// of a std::istream or of a file. Instead of one operator>> call, with its
+// locale and sentry overhead, per element, the input is read in large
+// blocks and every number of a block is parsed at once with
+// std::from_chars into a chunk, a std::vector<T>.
+//
+// parsed_chunks streams the chunks themselves. parsed_numbers streams their
+// elements: every node shares the ownership of its chunk through its head
+// pointer, so the elements are never copied out of it. Either way a block
+// is only read when the tail reaching it is first forced.
+//
+// Numbers follow the std::from_chars syntax, plus an optional leading '+'.
+// Unlike operator>>, which stops at the first unparsable token, a malformed
+// number throws std::runtime_error.
+
+
+#ifndef PARSED_STREAM_H
+#define PARSED_STREAM_H
+
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+
+
+namespace parsed_stream_detail
+{
+
+// Default number of bytes read per block
+const size_t default_block_size=1<<20;
+
+inline bool is_space(char c)
+{
+	return c==' ' || c=='\n' || c=='\t' || c=='\r' || c=='\v' || c=='\f';
+}
+
+// Input shared by the nodes of a parsed stream
+struct parse_state
+{
+	std::shared_ptr<std::istream> in_ptr_;
+	std::vector<char> buffer_;
+	size_t carry_;					// Bytes of a number cut by the end of the last block
+	size_t block_size_;
+	bool done_;
+	std::exception_ptr error_;		// Rethrown by every later read
+
+	parse_state(std::shared_ptr<std::istream> in_ptr, size_t block_size) :
+	in_ptr_(std::move(in_ptr)),
+	carry_(0),
+	block_size_(block_size),
+	done_(false) {}
+};
+
+// Parses the numbers of [begin, end), which holds whole numbers only, into chunk
+template <typename T>
+void parse_numbers(const char* begin, const char* end, std::vector<T>& chunk)
+{
+	const char* position=begin;
+
+	for(;;)
+	{
+		while(position<end && is_space(*position))
+			++position;
+
+		if(position==end)
+			return;
+
+		const char* first=position;
+
+		if(*position=='+')
+			++position;
+
+		T value;
+		std::from_chars_result result=std::from_chars(position, end, value);
+
+		if(result.ec!=std::errc() || (result.ptr<end && !is_space(*result.ptr)) || (first<position && *position=='-'))
+		{
+			const char* last=first;
+
+			while(last<end && !is_space(*last))
+				++last;
+
+			throw std::runtime_error("Function: parsed_numbers. Malformed number: "+std::string(first, last));
+		}
+
+		chunk.push_back(value);
+		position=result.ptr;
+	}
+}
+
+// Reads blocks until one holds a number. Empty at the end of the input.
+//
+// Once a read or a number fails, the input is left behind and every later
+// read throws the same exception.
+//
+template <typename T>
+std::vector<T> read_chunk(parse_state& state)
+{
+	if(state.error_)
+		std::rethrow_exception(state.error_);
+
+	std::vector<T> chunk;
+
+	try
+	{
+		while(chunk.empty() && !state.done_)
+		{
+			if(state.buffer_.size()<state.carry_+state.block_size_)
+				state.buffer_.resize(state.carry_+state.block_size_);
+
+			char* data=state.buffer_.data();
+
+			state.in_ptr_->read(data+state.carry_, std::streamsize(state.block_size_));
+
+			if(state.in_ptr_->bad())
+				throw std::runtime_error("Function: parsed_numbers. Cannot read the input.");
+
+			const char* end=data+state.carry_+size_t(state.in_ptr_->gcount());
+			const char* cut=end;
+
+			state.done_=!*state.in_ptr_;
+
+			// A number may go on in the next block: carry it over
+			if(!state.done_)
+				while(cut>data && !is_space(cut[-1]))
+					--cut;
+
+			parse_numbers(data, cut, chunk);
+
+			state.carry_=size_t(end-cut);
+			std::memmove(data, cut, state.carry_);
+		}
+	}
+	catch(...)
+	{
+		state.error_=std::current_exception();
+		throw;
+	}
+
+	return chunk;
+}
+
+// A parsed chunk and the input its successors come from
+template <typename T>
+struct chunk_holder : std::enable_shared_from_this<chunk_holder<T>>
+{
+	std::vector<T> values_;
+	std::shared_ptr<parse_state> state_ptr_;
+};
+
+// Streams the chunks parsed from state
+template <typename T>
+lazy_stream<std::vector<T>> chunks_from(const std::shared_ptr<parse_state>& state_ptr)
+{
+	std::shared_ptr<std::vector<T>> chunk_ptr=std::make_shared<std::vector<T>>(read_chunk<T>(*state_ptr));
+
+	if(chunk_ptr->empty())
+		return lazy_stream<std::vector<T>>();
+
+	return lazy_stream<std::vector<T>>::from_shared(std::move(chunk_ptr), [state_ptr]() {
+		return chunks_from<T>(state_ptr);
+		});
+}
+
+// Streams the numbers from index on in chunk, then those of the next chunks
+//
+// The tail generator only captures the chunk pointer and the index, small
+// enough for std::function to hold them without a heap allocation: the
+// node forcing it keeps the chunk alive through its head.
+//
+template <typename T>
+lazy_stream<T> numbers_from(chunk_holder<T>* chunk, size_t index)
+{
+	std::shared_ptr<chunk_holder<T>> chunk_ptr;
+
+	if(index<chunk->values_.size())
+		chunk_ptr=chunk->shared_from_this();
+	else
+	{
+		chunk_ptr=std::make_shared<chunk_holder<T>>();
+		chunk_ptr->values_=read_chunk<T>(*chunk->state_ptr_);
+		chunk_ptr->state_ptr_=chunk->state_ptr_;
+		index=0;
+
+		if(chunk_ptr->values_.empty())
+			return lazy_stream<T>();
+	}
+
+	chunk=chunk_ptr.get();
+
+	return lazy_stream<T>::from_shared(std::shared_ptr<T>(chunk_ptr, &chunk->values_[index]), [chunk, index]() {
+		return numbers_from<T>(chunk, index+1);
+		});
+}
+
+// Streams the numbers parsed from state
+template <typename T>
+lazy_stream<T> numbers_from(const std::shared_ptr<parse_state>& state_ptr)
+{
+	// An empty chunk standing before the first one
+	chunk_holder<T> start;
+
+	start.state_ptr_=state_ptr;
+
+	return numbers_from<T>(&start, 0);
+}
+
+// Opens the file at path for a parsed stream
+inline std::shared_ptr<std::istream> open_input(const std::string& path)
+{
+	std::shared_ptr<std::ifstream> in_ptr=std::make_shared<std::ifstream>(path, std::ios::binary);
+
+	if(!*in_ptr)
+		throw std::runtime_error("Function: parsed_numbers. Cannot open "+path+".");
+
+	return in_ptr;
+}
+
+// Shares in without owning it
+inline std::shared_ptr<std::istream> borrow_input(std::istream& in)
+{
+	return std::shared_ptr<std::istream>(&in, [](std::istream*){});
+}
+
+}	// namespace parsed_stream_detail
+
+
+// Creates the stream of the numbers of in, read block_size bytes at a time
+//
+// in must outlive the evaluation of the stream, and nothing else may read
+// from it meanwhile.
+//
+template <typename T>
+lazy_stream<T> parsed_numbers(std::istream& in, size_t block_size=parsed_stream_detail::default_block_size)
+{
+	if(block_size<1)
+		throw std::invalid_argument("Function: parsed_numbers. Block size must be positive.");
+
+	return parsed_stream_detail::numbers_from<T>(std::make_shared<parsed_stream_detail::parse_state>(
+		parsed_stream_detail::borrow_input(in), block_size));
+}
+
+
+// Creates the stream of the numbers of the file at path, read block_size bytes at a time
+template <typename T>
+lazy_stream<T> parsed_numbers(const std::string& path, size_t block_size=parsed_stream_detail::default_block_size)
+{
+	if(block_size<1)
+		throw std::invalid_argument("Function: parsed_numbers. Block size must be positive.");
+
+	return parsed_stream_detail::numbers_from<T>(std::make_shared<parsed_stream_detail::parse_state>(
+		parsed_stream_detail::open_input(path), block_size));
+}
+
+
+// Creates the stream of the chunks of numbers of in, one per block of block_size bytes
+//
+// Numbers cut by the end of a block belong to the next chunk. Blocks with
+// no number produce no chunk. in must outlive the evaluation of the
+// stream, and nothing else may read from it meanwhile.
+//
+template <typename T>
+lazy_stream<std::vector<T>> parsed_chunks(std::istream& in,
+	size_t block_size=parsed_stream_detail::default_block_size)
+{
+	if(block_size<1)
+		throw std::invalid_argument("Function: parsed_chunks. Block size must be positive.");
+
+	return parsed_stream_detail::chunks_from<T>(std::make_shared<parsed_stream_detail::parse_state>(
+		parsed_stream_detail::borrow_input(in), block_size));
+}
+
+
+// Creates the stream of the chunks of numbers of the file at path, one per block of block_size bytes
+template <typename T>
+lazy_stream<std::vector<T>> parsed_chunks(const std::string& path,
+	size_t block_size=parsed_stream_detail::default_block_size)
+{
+	if(block_size<1)
+		throw std::invalid_argument("Function: parsed_chunks. Block size must be positive.");
+
+	return parsed_stream_detail::chunks_from<T>(std::make_shared<parsed_stream_detail::parse_state>(
+		parsed_stream_detail::open_input(path), block_size));
+}
+
+
+#endif
@@ -0,0 +1,99 @@
+// ---------------------------------------------------------
+// - File: partition_benchmark                             -
+// - Scaling of lazy_stream<>::partition from 1 to 32      -
+// - concurrent consumers                                  -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// CPU-bound work done by the consumers on every element.
+unsigned long work(long value)
+{
+	unsigned long accu=(unsigned long)value;
+
+	for(int i=0; i<64; ++i)
+	{
+		accu^=accu<<13;
+		accu^=accu>>7;
+		accu^=accu<<17;
+	}
+
+	return accu;
+}
+
+
+// Consumes the k substreams of source from k threads.
+unsigned long consume(const lazy_stream<long>& source, size_t k, lazy_stream<long>::partition_policy policy)
+{
+	std::vector<lazy_stream<long>> parts=source.partition(k, policy);
+	std::vector<unsigned long> partials(k, 0);
+	std::vector<std::thread> consumers;
+
+	for(size_t i=0; i<k; ++i)
+		consumers.emplace_back([&parts, &partials, i]() {
+			unsigned long accu=0;
+
+			std::move(parts[i]).for_each_consume([&accu](const long& value){accu+=work(value);});
+			partials[i]=accu;
+			});
+
+	for(std::thread& consumer : consumers)
+		consumer.join();
+
+	unsigned long accu=0;
+
+	for(unsigned long partial : partials)
+		accu+=partial;
+
+	return accu;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 1000000;
+	const char* names[]={"round_robin", "hashed", "contiguous"};
+	lazy_stream<long>::partition_policy policies[]={
+		lazy_stream<long>::round_robin, lazy_stream<long>::hashed, lazy_stream<long>::contiguous};
+
+	unsigned long expected=0;
+
+	for(long i=0; i<n; ++i)
+		expected+=work(i);
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << n << " elements, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+	for(int p=0; p<3; ++p)
+	{
+		double base_ms=0;
+
+		for(size_t k=1; k<=32; k*=2)
+		{
+			unsigned long result=0;
+			double ms=time_ms([&](){result=consume(lazy_stream<long>::range(0, n), k, policies[p]);});
+
+			if(result!=expected)
+				throw std::logic_error("Substreams lost or repeated elements.");
+
+			if(k==1)
+				base_ms=ms;
+
+			std::cout << std::setw(11) << names[p] << ", " << std::setw(2) << k << " consumers: "
+						<< std::setw(9) << ms << "ms, speedup " << std::setw(6) << base_ms/ms << std::endl;
+		}
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread partition_benchmark.cpp -o partition_benchmark
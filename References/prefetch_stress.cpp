@@ -0,0 +1,156 @@
+// ---------------------------------------------------------
+// - File: prefetch_stress                                 -
+// - Element order, errors, cancellation and bounded       -
+// - memory of lazy_stream<>::prefetch (Linux)             -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "lazy_stream.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// Resident set size of this process, in bytes.
+long resident_bytes()
+{
+	long pages=0;
+	long resident=0;
+
+	if(FILE* statm=std::fopen("/proc/self/statm", "r"))
+	{
+		if(std::fscanf(statm, "%ld %ld", &pages, &resident)!=2)
+			resident=0;
+
+		std::fclose(statm);
+	}
+
+	return resident*sysconf(_SC_PAGESIZE);
+}
+
+
+// Elements generated so far by the sources below, on any thread.
+static std::atomic<long> generated(0);
+
+
+// [0..n) through a counting map, prefetched n_ahead elements ahead.
+//
+// Built apart so that no temporary keeps the head of the source alive
+// while the result is consumed.
+lazy_stream<long> prefetched(long n, size_t n_ahead)
+{
+	std::function<long (const long&)> counted=[](const long& value){++generated; return value;};
+
+	return lazy_stream<long>::range(0, n).map(counted).prefetch(n_ahead);
+}
+
+
+// {0, 1, 2,...} through a counting map that throws at fail, prefetched n_ahead elements ahead.
+lazy_stream<long> failing(long fail, size_t n_ahead)
+{
+	std::function<long (const long&)> counted=[fail](const long& value) -> long {
+		if(value==fail)
+			throw std::runtime_error("failed at "+std::to_string(value));
+
+		++generated;
+		return value;
+		};
+
+	return lazy_stream<long>::from(0).map(counted).prefetch(n_ahead);
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 1000000L;
+
+	// Element order, through a ring buffer of every size from one slot
+	for(size_t n_ahead : {1, 2, 7, 64})
+	{
+		long expected=0;
+
+		for(const long& value : prefetched(100000, n_ahead).consume())
+			expect(value==expected++, "order");
+
+		expect(expected==100000, "count");
+	}
+
+	expect(lazy_stream<long>().prefetch(4).empty(), "empty source");
+
+	// A held result keeps every element, as any lazy stream does
+	lazy_stream<long> held=prefetched(1000, 16);
+
+	expect(held.size()==1000 && held.get(999)==999 && held.get(0)==0, "held stream");
+
+	// The error is rethrown when the consumer reaches it, after every element before it
+	long count=0;
+	bool thrown=false;
+
+	try
+	{
+		for(const long& value : failing(5000, 8).consume())
+			expect(value==count++, "order before the error");
+	}
+	catch(const std::runtime_error& error)
+	{
+		thrown=std::string(error.what())=="failed at 5000";
+	}
+
+	expect(thrown && count==5000, "error rethrown in place");
+
+	// Dropping the result cancels the thread: the source stops n_ahead elements ahead at most
+	generated=0;
+
+	{
+		lazy_stream<long> infinite=failing(-1, 32);
+
+		expect(infinite.get(9)==9, "infinite source");
+	}
+
+	expect(generated<=10+32+1, "cancelled after the last read");
+
+	generated=0;
+	failing(-1, 32);
+
+	expect(generated<=32+1, "cancelled before any read");
+
+	// Consumed, the pipeline keeps only the ring buffer and the nodes in flight
+	long baseline=resident_bytes();
+	long peak=0;
+
+	count=0;
+	prefetched(n, 64).for_each_consume([&count, &peak, baseline](const long& value){
+		expect(value==count++, "order of the long walk");
+
+		if(count%(1L<<16)==0)
+			peak=std::max(peak, resident_bytes()-baseline);
+		});
+
+	expect(count==n, "count of the long walk");
+	std::cout << "for_each_consume of " << n << " prefetched elements: peak " << peak/1024
+				<< "KiB over baseline" << std::endl;
+	expect(peak<16L*1024*1024, "bounded memory");
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread prefetch_stress.cpp -o prefetch_stress
@@ -0,0 +1,161 @@
+// ---------------------------------------------------------
+// - File: random_benchmark                                -
+// - Counter-based random sources against std::mt19937,    -
+// - and a parallel Monte Carlo run on substreams          -
+// ---------------------------------------------------------
+
+
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+#include "random_stream.h"
+
+
+// Uniform numbers in [0, 1) drawn from engine inside the tail generator.
+lazy_stream<double> engine_numbers(const std::shared_ptr<std::mt19937_64>& engine)
+{
+	double value=std::generate_canonical<double, 53>(*engine);
+
+	return lazy_stream<double>(value, [engine](){return engine_numbers(engine);});
+}
+
+
+// Sums the first n elements of a stream, consuming it.
+double sum(lazy_stream<double>&& stream, long n)
+{
+	double accu=0;
+
+	std::move(stream).take(n).for_each_consume([&accu](const double& value){accu+=value;});
+
+	return accu;
+}
+
+
+// Sums the first n elements of a stream of chunks, consuming it.
+double sum_chunks(lazy_stream<std::vector<double>>&& stream, long n)
+{
+	double accu=0;
+
+	for(const std::vector<double>& chunk : std::move(stream).consume())
+		for(const double& value : chunk)
+		{
+			if(n--<=0)
+				return accu;
+
+			accu+=value;
+		}
+
+	return accu;
+}
+
+
+// Counts the points of task in the quarter disk, samples points drawn from its substream.
+long task_hits(std::uint64_t seed, std::uint64_t task, long samples)
+{
+	long hits=0;
+
+	for(const std::vector<double>& chunk : random_chunks<double>(seed, task).consume())
+		for(size_t i=0; i+1<chunk.size(); i+=2)
+		{
+			if(samples--<=0)
+				return hits;
+
+			if(chunk[i]*chunk[i]+chunk[i+1]*chunk[i+1]<1.0)
+				++hits;
+		}
+
+	return hits;
+}
+
+
+// Estimates pi from tasks tasks run on threads workers, each task on its own substream.
+double parallel_pi(std::uint64_t seed, size_t tasks, long samples, size_t threads)
+{
+	std::vector<long> hits(tasks);
+	std::vector<std::future<void>> workers;
+
+	for(size_t worker=0; worker<threads; ++worker)
+		workers.push_back(std::async(std::launch::async, [&hits, seed, tasks, samples, threads, worker]() {
+			for(size_t task=worker; task<tasks; task+=threads)
+				hits[task]=task_hits(seed, task, samples);
+			}));
+
+	for(std::future<void>& worker : workers)
+		worker.get();
+
+	long total=0;
+
+	for(long hit : hits)
+		total+=hit;
+
+	return 4.0*double(total)/(double(tasks)*double(samples));
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 1000000;
+	std::uint64_t seed=20261017;
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	// Raw words, the block path against one counter at a time
+	std::vector<std::uint32_t> words(4*size_t(n));
+
+	double fill_ms=time_ms([&](){random_stream_detail::philox_fill(seed, 0, 0, size_t(n), words.data());});
+	double block_ms=time_ms([&](){
+		for(long i=0; i<n; ++i)
+			random_stream_detail::philox_block(seed, std::uint64_t(i), 0, &words[4*size_t(i)]);
+		});
+
+	std::cout << "philox words: philox_fill " << std::setw(7) << 1e6*fill_ms/(4.0*n) << "ns/word, philox_block "
+				<< std::setw(7) << 1e6*block_ms/(4.0*n) << "ns/word" << std::endl;
+
+	// Streams of uniform doubles
+	double engine_sum=0;
+	double random_sum=0;
+	double chunked_sum=0;
+
+	// The chunks first: the heap left by a million freed nodes slows them down
+	double chunked_ms=time_ms([&](){chunked_sum=sum_chunks(random_chunks<double>(seed), n);});
+	double random_ms=time_ms([&](){random_sum=sum(random_numbers<double>(seed), n);});
+	double engine_ms=time_ms([&](){engine_sum=sum(engine_numbers(std::make_shared<std::mt19937_64>(seed)), n);});
+
+	if(random_sum!=chunked_sum)
+		throw std::logic_error("Chunks and numbers disagree.");
+
+	std::cout << "random_chunks:        " << std::setw(7) << 1e6*chunked_ms/n << "ns/elem" << std::endl;
+	std::cout << "random_numbers:       " << std::setw(7) << 1e6*random_ms/n << "ns/elem (mean " << random_sum/n << ")" << std::endl;
+	std::cout << "mt19937_64 generator: " << std::setw(7) << 1e6*engine_ms/n << "ns/elem (mean " << engine_sum/n << ")" << std::endl;
+
+	// Monte Carlo on 64 substreams: the same bits whatever the number of threads
+	size_t tasks=64;
+	long samples=n/4;
+	double reference=0;
+
+	for(size_t threads : {1, 2, 4, 8})
+	{
+		double pi=0;
+		double pi_ms=time_ms([&](){pi=parallel_pi(seed, tasks, samples, threads);});
+
+		if(threads==1)
+			reference=pi;
+		else if(pi!=reference)
+			throw std::logic_error("Irreproducible parallel run.");
+
+		std::cout << "pi on " << threads << " thread(s): " << std::setprecision(9) << pi << std::setprecision(3)
+					<< ", " << std::setw(9) << pi_ms << "ms" << std::endl;
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -march=native -pthread random_benchmark.cpp -o random_benchmark
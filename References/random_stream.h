@@ -0,0 +1,488 @@
+// ---------------------------------------------------------
+// - Counter-based random sources for lazy_stream<>        -
+// ---------------------------------------------------------
+
+
+// random_numbers and random_chunks stream pseudo-random numbers drawn from
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3", SC'11), a counter-based generator: the 4 words of output number c of
+// substream s are a keyed bijection of the counter (c, s), with no state
+// carried from one output to the next. So:
+//  - any offset is reached in O(1), by starting from its counter;
+//  - substreams differing in s are independent streams of the same seed,
+//    one per task of a parallel run;
+//  - the numbers are generated a block of counters at a time, independently
+//    of each other, 8 counters per instruction where AVX2 is enabled
+//    (-mavx2, -march=native). SSE2 has no 32-bit high multiply and gains
+//    nothing on the scalar rounds.
+//
+// A node of the stream depends on nothing but the seed, the substream and
+// its offset: streams of the same arguments hold the same numbers whatever
+// thread forces them and in whatever order. A parallel run is reproducible
+// bit for bit as long as its tasks, not its threads, own the substreams.
+//
+// philox_engine draws the same numbers one at a time, as a std::mt19937
+// does, for the standard distributions.
+
+
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+namespace random_stream_detail
+{
+
+// Default number of elements generated per block
+const size_t default_block_size=1024;
+
+// Philox4x32 multipliers and key increments (Weyl sequence)
+const std::uint32_t philox_m0=0xD2511F53;
+const std::uint32_t philox_m1=0xCD9E8D57;
+const std::uint32_t philox_w0=0x9E3779B9;
+const std::uint32_t philox_w1=0xBB67AE85;
+const int philox_rounds=10;
+
+// Writes the 4 words of counter (position, substream) under seed to out
+inline void philox_block(std::uint64_t seed, std::uint64_t position, std::uint64_t substream, std::uint32_t* out)
+{
+	std::uint32_t x0=std::uint32_t(position);
+	std::uint32_t x1=std::uint32_t(position>>32);
+	std::uint32_t x2=std::uint32_t(substream);
+	std::uint32_t x3=std::uint32_t(substream>>32);
+	std::uint32_t k0=std::uint32_t(seed);
+	std::uint32_t k1=std::uint32_t(seed>>32);
+
+	for(int round=0; round<philox_rounds; ++round)
+	{
+		std::uint64_t product0=std::uint64_t(philox_m0)*x0;
+		std::uint64_t product1=std::uint64_t(philox_m1)*x2;
+		std::uint32_t y0=std::uint32_t(product1>>32)^x1^k0;
+		std::uint32_t y2=std::uint32_t(product0>>32)^x3^k1;
+
+		x1=std::uint32_t(product1);
+		x3=std::uint32_t(product0);
+		x0=y0;
+		x2=y2;
+		k0+=philox_w0;
+		k1+=philox_w1;
+	}
+
+	out[0]=x0;
+	out[1]=x1;
+	out[2]=x2;
+	out[3]=x3;
+}
+
+#if defined(__AVX2__)
+
+// Gets the high and low 32-bit halves of the lane-wise products of a and m, m broadcast
+//
+// _mm256_mul_epu32 only multiplies the even lanes: the odd ones are shifted
+// down, multiplied apart and blended back.
+//
+inline void philox_mulhilo(__m256i a, __m256i m, __m256i& high, __m256i& low)
+{
+	__m256i even=_mm256_mul_epu32(a, m);
+	__m256i odd=_mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+
+	low=_mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+	high=_mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+// Writes the words of counters [position, position+count) to out, 8 counters per round
+//
+// The counters are held word by word, lane i of x0..x3 for counter
+// position+i, and transposed back to counter order when stored.
+//
+inline void philox_fill(std::uint64_t seed, std::uint64_t position, std::uint64_t substream,
+	size_t count, std::uint32_t* out)
+{
+	const __m256i m0=_mm256_set1_epi32(int(philox_m0));
+	const __m256i m1=_mm256_set1_epi32(int(philox_m1));
+	size_t i=0;
+
+	for(; i+8<=count; i+=8)
+	{
+		std::uint32_t low[8];
+		std::uint32_t high[8];
+
+		for(size_t lane=0; lane<8; ++lane)
+		{
+			low[lane]=std::uint32_t(position+i+lane);
+			high[lane]=std::uint32_t((position+i+lane)>>32);
+		}
+
+		__m256i x0=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(low));
+		__m256i x1=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(high));
+		__m256i x2=_mm256_set1_epi32(int(std::uint32_t(substream)));
+		__m256i x3=_mm256_set1_epi32(int(std::uint32_t(substream>>32)));
+		std::uint32_t k0=std::uint32_t(seed);
+		std::uint32_t k1=std::uint32_t(seed>>32);
+
+		for(int round=0; round<philox_rounds; ++round)
+		{
+			__m256i high0, low0, high1, low1;
+
+			philox_mulhilo(x0, m0, high0, low0);
+			philox_mulhilo(x2, m1, high1, low1);
+			x0=_mm256_xor_si256(_mm256_xor_si256(high1, x1), _mm256_set1_epi32(int(k0)));
+			x2=_mm256_xor_si256(_mm256_xor_si256(high0, x3), _mm256_set1_epi32(int(k1)));
+			x1=low1;
+			x3=low0;
+			k0+=philox_w0;
+			k1+=philox_w1;
+		}
+
+		// Counters i and i+4 share the 128-bit halves of each register
+		__m256i t0=_mm256_unpacklo_epi32(x0, x1);
+		__m256i t1=_mm256_unpacklo_epi32(x2, x3);
+		__m256i t2=_mm256_unpackhi_epi32(x0, x1);
+		__m256i t3=_mm256_unpackhi_epi32(x2, x3);
+		__m256i c04=_mm256_unpacklo_epi64(t0, t1);
+		__m256i c15=_mm256_unpackhi_epi64(t0, t1);
+		__m256i c26=_mm256_unpacklo_epi64(t2, t3);
+		__m256i c37=_mm256_unpackhi_epi64(t2, t3);
+		__m256i* target=reinterpret_cast<__m256i*>(out+4*i);
+
+		_mm256_storeu_si256(target, _mm256_permute2x128_si256(c04, c15, 0x20));
+		_mm256_storeu_si256(target+1, _mm256_permute2x128_si256(c26, c37, 0x20));
+		_mm256_storeu_si256(target+2, _mm256_permute2x128_si256(c04, c15, 0x31));
+		_mm256_storeu_si256(target+3, _mm256_permute2x128_si256(c26, c37, 0x31));
+	}
+
+	for(; i<count; ++i)
+		philox_block(seed, position+i, substream, out+4*i);
+}
+
+#else
+
+// Writes the words of counters [position, position+count) to out
+inline void philox_fill(std::uint64_t seed, std::uint64_t position, std::uint64_t substream,
+	size_t count, std::uint32_t* out)
+{
+	for(size_t i=0; i<count; ++i)
+		philox_block(seed, position+i, substream, out+4*i);
+}
+
+#endif
+
+// Numbers made of the 32-bit words of the generator
+//
+// words consecutive words make one number: unsigned integers take all
+// their bits, floating-point numbers are uniform in [0, 1), on the 24 or
+// 53 high bits of their words. Other types have no random form.
+//
+template <typename T>
+struct value_traits
+{
+	static const bool enabled=false;
+};
+
+template <>
+struct value_traits<std::uint32_t>
+{
+	static const bool enabled=true;
+	static const size_t words=1;
+
+	static std::uint32_t from_words(const std::uint32_t* word)
+	{
+		return word[0];
+	}
+};
+
+template <>
+struct value_traits<std::uint64_t>
+{
+	static const bool enabled=true;
+	static const size_t words=2;
+
+	static std::uint64_t from_words(const std::uint32_t* word)
+	{
+		return std::uint64_t(word[1])<<32 | word[0];
+	}
+};
+
+template <>
+struct value_traits<float>
+{
+	static const bool enabled=true;
+	static const size_t words=1;
+
+	static float from_words(const std::uint32_t* word)
+	{
+		return float(word[0]>>8)*(1.0f/16777216.0f);
+	}
+};
+
+template <>
+struct value_traits<double>
+{
+	static const bool enabled=true;
+	static const size_t words=2;
+
+	static double from_words(const std::uint32_t* word)
+	{
+		return double((std::uint64_t(word[1])<<32 | word[0])>>11)*(1.0/9007199254740992.0);
+	}
+};
+
+// Where a random stream goes on: its next counter and how much of it is left behind
+struct random_state
+{
+	std::uint64_t seed_;
+	std::uint64_t substream_;
+	std::uint64_t position_;		// Next counter
+	size_t skip_;					// Words of the first counter before the offset
+	size_t counters_;				// Counters per block
+};
+
+// Generates the numbers of the block of state, and moves state to the next one
+template <typename T>
+std::vector<T> read_block(random_state& state)
+{
+	typedef value_traits<T> traits;
+
+	std::vector<std::uint32_t> words(4*state.counters_);
+	std::vector<T> block;
+
+	philox_fill(state.seed_, state.position_, state.substream_, state.counters_, words.data());
+	block.reserve((words.size()-state.skip_)/traits::words);
+
+	for(size_t i=state.skip_; i<words.size(); i+=traits::words)
+		block.push_back(traits::from_words(&words[i]));
+
+	state.position_+=state.counters_;
+	state.skip_=0;
+
+	return block;
+}
+
+// Gets the state of the stream from offset on, block_size elements per block at least
+template <typename T>
+random_state start_state(std::uint64_t seed, std::uint64_t substream, std::uint64_t offset, size_t block_size)
+{
+	typedef value_traits<T> traits;
+
+	random_state state;
+	std::uint64_t word=offset*traits::words;
+
+	state.seed_=seed;
+	state.substream_=substream;
+	state.position_=word/4;
+	state.skip_=size_t(word%4);
+	state.counters_=(block_size*traits::words+3)/4;
+
+	return state;
+}
+
+// A generated block and where the next one starts
+template <typename T>
+struct block_holder : std::enable_shared_from_this<block_holder<T>>
+{
+	std::vector<T> values_;
+	random_state next_;
+};
+
+// Streams the blocks generated from state on
+template <typename T>
+lazy_stream<std::vector<T>> blocks_from(random_state state)
+{
+	std::shared_ptr<std::vector<T>> block_ptr=std::make_shared<std::vector<T>>(read_block<T>(state));
+
+	return lazy_stream<std::vector<T>>::from_shared(std::move(block_ptr), [state]() {
+		return blocks_from<T>(state);
+		});
+}
+
+// Streams the numbers from index on in block, then those of the next blocks
+//
+// As in parsed_stream.h, the tail generator only captures the block
+// pointer and the index, and the node forcing it keeps the block alive
+// through its head. The next block only depends on the state saved in
+// this one: nothing is shared between blocks.
+//
+template <typename T>
+lazy_stream<T> numbers_from(block_holder<T>* block, size_t index)
+{
+	std::shared_ptr<block_holder<T>> block_ptr;
+
+	if(index<block->values_.size())
+		block_ptr=block->shared_from_this();
+	else
+	{
+		block_ptr=std::make_shared<block_holder<T>>();
+		block_ptr->next_=block->next_;
+		block_ptr->values_=read_block<T>(block_ptr->next_);
+		index=0;
+	}
+
+	block=block_ptr.get();
+
+	return lazy_stream<T>::from_shared(std::shared_ptr<T>(block_ptr, &block->values_[index]), [block, index]() {
+		return numbers_from<T>(block, index+1);
+		});
+}
+
+}	// namespace random_stream_detail
+
+
+// Creates the endless stream of the random numbers of substream under seed, from offset on
+//
+// T is std::uint32_t, std::uint64_t, or float or double uniform in [0, 1).
+// Element i of the stream is element offset+i of the stream from 0, for
+// offsets up to 2^63. block_size elements at least are
+// generated at a time, when the tail reaching them is first forced.
+//
+template <typename T>
+lazy_stream<T> random_numbers(std::uint64_t seed, std::uint64_t substream=0, std::uint64_t offset=0,
+	size_t block_size=random_stream_detail::default_block_size)
+{
+	static_assert(random_stream_detail::value_traits<T>::enabled,
+		"random_numbers<T>: T must be std::uint32_t, std::uint64_t, float or double.");
+
+	if(block_size<1)
+		throw std::invalid_argument("Function: random_numbers. Block size must be positive.");
+
+	// An empty block standing before the first one
+	random_stream_detail::block_holder<T> start;
+
+	start.next_=random_stream_detail::start_state<T>(seed, substream, offset, block_size);
+
+	return random_stream_detail::numbers_from<T>(&start, 0);
+}
+
+
+// Creates the endless stream of the blocks of random numbers of substream under seed, from offset on
+//
+// The blocks hold block_size elements at least, rounded up to whole
+// counters, but the first one starts at offset. Their concatenation is the
+// stream of random_numbers with the same arguments.
+//
+template <typename T>
+lazy_stream<std::vector<T>> random_chunks(std::uint64_t seed, std::uint64_t substream=0, std::uint64_t offset=0,
+	size_t block_size=random_stream_detail::default_block_size)
+{
+	static_assert(random_stream_detail::value_traits<T>::enabled,
+		"random_chunks<T>: T must be std::uint32_t, std::uint64_t, float or double.");
+
+	if(block_size<1)
+		throw std::invalid_argument("Function: random_chunks. Block size must be positive.");
+
+	return random_stream_detail::blocks_from<T>(random_stream_detail::start_state<T>(seed, substream, offset, block_size));
+}
+
+
+// ---------------------------------------------------------
+// - Class: philox_engine                                  -
+// - The words of random_numbers<std::uint32_t> as a       -
+// - standard random number engine                         -
+// ---------------------------------------------------------
+
+
+// A UniformRandomBitGenerator drawing the words of substream under seed
+//
+// Words are generated block_counters counters at a time into a buffer.
+// discard(n) jumps n words ahead in O(1), and split(s) gets the engine of
+// substream s of the same seed, at its start.
+//
+class philox_engine
+{
+	static const size_t block_counters=16;
+
+	std::uint64_t seed_;
+	std::uint64_t substream_;
+	std::uint64_t position_;				// Counter of the buffer
+	size_t index_;							// Next word of the buffer
+	std::uint32_t buffer_[4*block_counters];
+
+	// Generates the block of counter position (private)
+	void refill(std::uint64_t position)
+	{
+		position_=position;
+		random_stream_detail::philox_fill(seed_, position_, substream_, block_counters, buffer_);
+	}
+
+public:
+
+	typedef std::uint32_t result_type;
+
+	// Creates the engine of substream under seed
+	explicit philox_engine(std::uint64_t seed=0, std::uint64_t substream=0) :
+	seed_(seed),
+	substream_(substream),
+	index_(0)
+	{
+		refill(0);
+	}
+
+	// Gets the smallest word
+	static constexpr result_type min() {return 0;}
+
+	// Gets the largest word
+	static constexpr result_type max() {return 0xFFFFFFFF;}
+
+	// Draws the next word
+	result_type operator()()
+	{
+		if(index_==4*block_counters)
+		{
+			refill(position_+block_counters);
+			index_=0;
+		}
+
+		return buffer_[index_++];
+	}
+
+	// Skips the next n words
+	void discard(unsigned long long n)
+	{
+		std::uint64_t word=4*position_+index_+n;
+		std::uint64_t position=word/(4*block_counters)*block_counters;
+
+		if(position!=position_)
+			refill(position);
+
+		index_=size_t(word-4*position);
+	}
+
+	// Gets the engine of substream of the same seed
+	philox_engine split(std::uint64_t substream) const
+	{
+		return philox_engine(seed_, substream);
+	}
+
+	// Gets the number of words drawn so far
+	std::uint64_t position() const
+	{
+		return 4*position_+index_;
+	}
+
+	// Checks if both engines draw the same words from now on
+	bool operator==(const philox_engine& other) const
+	{
+		return seed_==other.seed_ && substream_==other.substream_ && position()==other.position();
+	}
+
+	// Checks if the engines draw different words from now on
+	bool operator!=(const philox_engine& other) const
+	{
+		return !(*this==other);
+	}
+};
+
+
+#endif
@@ -0,0 +1,104 @@
+// ---------------------------------------------------------
+// - File: ranges_sample                                   -
+// - lazy_stream<> with iterators, std::ranges algorithms  -
+// - and parallel algorithms (C++20)                       -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+static_assert(std::forward_iterator<lazy_stream<int>::const_iterator>);
+static_assert(std::ranges::forward_range<lazy_stream<int>>);
+static_assert(std::ranges::forward_range<const lazy_stream<int>>);
+
+
+int main(int argn, char *argc[])
+{
+	try
+	{
+		std::function<bool (const long&)> odd=[](const long& value){return value%2==1;};
+		lazy_stream<long> odds=lazy_stream<long>::from(0).filter(odd);
+
+		// Range-based for over an infinite stream, stopped by hand.
+		std::cout << "First odd numbers:";
+
+		for(long value : odds)
+		{
+			if(value>20)
+				break;
+
+			std::cout << " " << value;
+		}
+
+		std::cout << std::endl;
+
+		// std::ranges algorithms and views over an infinite stream: end() is
+		// only a sentinel, it is never reached.
+		auto found=std::ranges::find_if(odds, [](long value){return value*value>1000;});
+
+		std::cout << "First odd number whose square exceeds 1000: " << *found << std::endl;
+
+		std::cout << "Squares of the first odd numbers:";
+
+		for(long value : odds | std::views::take(5) | std::views::transform([](long value){return value*value;}))
+			std::cout << " " << value;
+
+		std::cout << std::endl;
+
+		// Forward iterators walk the memoized nodes again at no cost.
+		lazy_stream<long> prefix=odds.take(1000);
+
+		if(!std::equal(prefix.begin(), prefix.end(), odds.begin()))
+			throw std::logic_error("A second pass disagrees.");
+
+		// Standard and parallel algorithms straight over the stream.
+		std::atomic<long> sum(0);
+
+		std::for_each(std::execution::par, prefix.begin(), prefix.end(),
+			[&sum](long value){sum+=value;});
+
+		std::cout << "Sum of the first 1000 odd numbers: " << sum
+					<< " (std::accumulate: " << std::accumulate(prefix.begin(), prefix.end(), 0L) << ")"
+					<< std::endl;
+
+		// to_vector against to_list
+		long n=argn>1 ? std::atol(argc[1]) : 1000000;
+		lazy_stream<long> stream=odds.take(n);
+
+		stream.size();	// Memoizes the whole stream before timing
+
+		std::vector<long> vector;
+		std::list<long> list;
+
+		double list_ms=time_ms([&](){list=stream.to_list();});
+		double vector_ms=time_ms([&](){vector=stream.to_vector(n);});
+
+		if(!std::equal(vector.begin(), vector.end(), list.begin()))
+			throw std::logic_error("to_vector and to_list disagree.");
+
+		std::cout << n << " elements: to_list " << list_ms << "ms, to_vector(" << n << ") "
+					<< vector_ms << "ms" << std::endl;
+	}
+	catch(std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
+
+// compile this> g++ -std=c++20 -O2 -pthread ranges_sample.cpp -o ranges_sample
@@ -0,0 +1,117 @@
+// ---------------------------------------------------------
+// - File: rank_benchmark                                  -
+// - Streaming top_k, distinct and quantiles of a          -
+// - lazy_stream<> against to_vector and the std library   -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+#include "benchmark_timer.h"
+#include "sketch_stream.h"
+
+
+// n pseudo-random values, about n/4 of them distinct. The temporary range
+// dies here, so that nothing retains the nodes already read.
+lazy_stream<long> scrambled(long n)
+{
+	return lazy_stream<long>::range(0, n).map<long>([n](const long& index){
+		return (index*2654435761L+12345)%std::max(1L, n/4);
+		});
+}
+
+
+// All the values of scrambled(n) in a vector.
+std::vector<long> to_vector(long n)
+{
+	std::vector<long> accu;
+
+	accu.reserve(n);
+	scrambled(n).for_each_consume([&accu](const long& value){accu.push_back(value);});
+
+	return accu;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 4000000;
+	size_t k=100;
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << n << " elements" << std::endl;
+
+	// top_k against a vector and std::partial_sort
+	std::vector<long> top;
+	std::vector<long> expected;
+
+	double top_ms=time_ms([&](){top=top_k(scrambled(n), k).to_vector();});
+	double partial_ms=time_ms([&](){
+		expected=to_vector(n);
+		std::partial_sort(expected.begin(), expected.begin()+k, expected.end(), std::greater<long>());
+		expected.resize(k);
+		});
+
+	if(top!=expected)
+		throw std::logic_error("Unexpected top_k.");
+
+	std::cout << "top_k(" << k << "):                 " << std::setw(8) << top_ms << "ms, to_vector+partial_sort "
+				<< std::setw(8) << partial_ms << "ms" << std::endl;
+
+	// distinct against std::unordered_set
+	size_t exact=0;
+	size_t approximate=0;
+	size_t unique=0;
+
+	double exact_ms=time_ms([&](){exact=distinct(scrambled(n)).size();});
+	double bloom_ms=time_ms([&](){approximate=distinct(scrambled(n), n/4, 0.01).size();});
+	double set_ms=time_ms([&](){
+		std::unordered_set<long> seen;
+
+		scrambled(n).for_each_consume([&](const long& value){unique+=seen.insert(value).second;});
+		});
+
+	if(exact!=unique || approximate>unique)
+		throw std::logic_error("Unexpected distinct.");
+
+	std::cout << "distinct():                 " << std::setw(8) << exact_ms << "ms, unordered_set            "
+				<< std::setw(8) << set_ms << "ms" << std::endl;
+	std::cout << "distinct(n/4, 0.01):        " << std::setw(8) << bloom_ms << "ms, "
+				<< unique-approximate << " first occurrences dropped of " << unique << std::endl;
+
+	// quantiles against a sorted vector
+	double eps=0.001;
+	quantile_sketch<long> sketch;
+	std::vector<long> sorted;
+
+	double sketch_ms=time_ms([&](){sketch=quantiles(scrambled(n), eps);});
+	double sort_ms=time_ms([&](){
+		sorted=to_vector(n);
+		std::sort(sorted.begin(), sorted.end());
+		});
+
+	double error=0;
+
+	for(int i=0; i<=100; ++i)
+	{
+		long rank=long(std::lower_bound(sorted.begin(), sorted.end(), sketch.quantile(i/100.0))-sorted.begin());
+
+		error=std::max(error, std::fabs(double(rank)-std::min(double(n-1), i/100.0*n))/n);
+	}
+
+	std::cout << "quantiles(" << std::setprecision(3) << eps << std::setprecision(1) << "):           "
+				<< std::setw(8) << sketch_ms << "ms, to_vector+sort          " << std::setw(8) << sort_ms << "ms" << std::endl;
+	std::cout << std::setprecision(5) << "sketch: " << sketch.retained() << " elements held, max rank error " << error
+				<< std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread rank_benchmark.cpp -o rank_benchmark
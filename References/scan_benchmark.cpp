@@ -0,0 +1,134 @@
+// ---------------------------------------------------------
+// - File: scan_benchmark                                  -
+// - parallel_scan against std::inclusive_scan, with and   -
+// - without execution policies (C++17, TBB backend)       -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+#include "parallel_scan.h"
+
+
+// Best wall time of 3 runs of fn, each after setup.
+double best_ms(const std::function<void ()>& setup, const std::function<void ()>& fn)
+{
+	double accu=0;
+
+	for(int i=0; i<3; ++i)
+	{
+		setup();
+
+		double ms=time_ms(fn);
+
+		accu=i==0 ? ms : std::min(accu, ms);
+	}
+
+	return accu;
+}
+
+
+// Do two scans agree, exactly for integers, to the rounding of n additions for floating point?
+template <typename T>
+bool agree(const std::vector<T>& left, const std::vector<T>& right)
+{
+	double tolerance=double(std::numeric_limits<T>::epsilon())*double(right.size());
+
+	for(size_t i=0; i<left.size(); ++i)
+		if(std::fabs(double(left[i])-double(right[i]))>tolerance*std::fabs(double(right[i])))
+			return false;
+
+	return left.size()==right.size();
+}
+
+
+// Prints the scan times of n values of type T, in ns per element. Every
+// scan runs in place, over a copy of the input.
+template <typename T>
+void report(const char* name, size_t n)
+{
+	std::vector<T> input(n);
+	std::vector<T> expected(n);
+	std::vector<T> work(n);
+
+	for(size_t i=0; i<n; ++i)
+		input[i]=T((i*2654435761u)%1000);
+
+	std::partial_sum(input.begin(), input.end(), expected.begin());
+
+	auto copy=[&](){std::copy(input.begin(), input.end(), work.begin());};
+	auto ns=[n](double ms){return 1e6*ms/double(n);};
+
+	// A generic op on the same type, for the blocked algorithm without SIMD
+	auto add=[](const T& left, const T& right){return left+right;};
+
+	std::function<void ()> scans[]={
+		[&](){std::inclusive_scan(work.begin(), work.end(), work.begin());},
+		[&](){std::inclusive_scan(std::execution::seq, work.begin(), work.end(), work.begin());},
+		[&](){std::inclusive_scan(std::execution::par, work.begin(), work.end(), work.begin());},
+		[&](){std::inclusive_scan(std::execution::par_unseq, work.begin(), work.end(), work.begin());},
+		[&](){work=parallel_scan(std::move(work), std::plus<T>(), 1);},
+		[&](){work=parallel_scan(std::move(work));},
+		[&](){work=parallel_scan(std::move(work), add);}};
+	double times[7];
+
+	for(int i=0; i<7; ++i)
+	{
+		times[i]=ns(best_ms(copy, scans[i]));
+
+		if(!agree(work, expected))
+			throw std::logic_error("Scans disagree.");
+	}
+
+	std::cout << std::setw(6) << name << ": inclusive_scan " << std::setw(6) << times[0]
+				<< ", seq " << std::setw(6) << times[1] << ", par " << std::setw(6) << times[2]
+				<< ", par_unseq " << std::setw(6) << times[3] << std::endl;
+	std::cout << std::setw(6) << "" << "  parallel_scan, 1 thread " << std::setw(6) << times[4]
+				<< ", all threads " << std::setw(6) << times[5] << ", generic op " << std::setw(6) << times[6]
+				<< std::endl;
+}
+
+
+int main(int argn, char *argc[])
+{
+	size_t n=argn>1 ? std::atol(argc[1]) : size_t(1)<<24;
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << n << " elements, " << std::thread::hardware_concurrency() << " hardware threads, ns per element"
+				<< std::endl;
+
+	report<int>("int", n);
+	report<long>("long", n);
+	report<float>("float", n);
+	report<double>("double", n);
+
+	// Running totals of a lazy_stream<>, the stream counterpart
+	long total=0;
+	double lazy_ms=time_ms([&](){
+		total=lazy_stream<long>::range(0, 1000000).scan_left<long>(0L, [](const long& accu, const long& value){
+			return accu+value;
+			}).drop(1000000).head();
+		});
+
+	if(total!=999999L*1000000/2)
+		throw std::logic_error("Unexpected scan_left.");
+
+	std::cout << "lazy_stream<>::scan_left: " << std::setw(6) << 1e6*lazy_ms/1000000 << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++17 -O2 -pthread scan_benchmark.cpp -o scan_benchmark -ltbb
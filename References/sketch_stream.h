@@ -0,0 +1,407 @@
+// ---------------------------------------------------------
+// - Top-k, distinct and quantiles of lazy_stream<>        -
+// ---------------------------------------------------------
+
+
+// top_k reads a finite stream once, keeping its k greatest elements in a
+// heap. distinct filters a stream, infinite or not, down to the first
+// occurrence of every element, checked exactly in a hash set or
+// approximately in a Bloom filter of fixed size. quantiles summarizes a
+// finite stream in a quantile_sketch: a mergeable summary answering ranks
+// and quantiles within eps*count, whatever the length of the stream.
+//
+// Every function takes its source stream by value: pass it with
+// std::move, as in top_k(std::move(stream), 10), so that its nodes are
+// released once read when no other copy of the stream is alive.
+
+
+#ifndef SKETCH_STREAM_H
+#define SKETCH_STREAM_H
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include "hash_table.h"
+#include "lazy_stream.h"
+#include "sorted_stream.h"
+
+
+namespace sketch_stream_detail
+{
+
+// Bloom filter of hashes, sized for a number of hashes and a false positive rate
+class bloom_filter
+{
+	std::vector<uint64_t> words_;
+	size_t mask_;			// Bits-1, the bits a power of 2
+	size_t probes_;
+
+public:
+
+	bloom_filter(size_t expected_count, double false_positive_rate)
+	{
+		if(expected_count<1)
+			throw std::invalid_argument("Function: distinct. Expected count must be positive.");
+
+		if(!(false_positive_rate>0 && false_positive_rate<1))
+			throw std::invalid_argument("Function: distinct. False positive rate must be in (0, 1).");
+
+		const double ln2=std::log(2.0);
+		double bits=-double(expected_count)*std::log(false_positive_rate)/(ln2*ln2);
+		size_t size=64;
+
+		while(double(size)<bits)
+			size*=2;
+
+		words_.assign(size/64, 0);
+		mask_=size-1;
+		probes_=std::max(size_t(1), size_t(std::lround(bits/double(expected_count)*ln2)));
+	}
+
+	// Sets the bits of hash. Returns false if they were all set already.
+	bool insert(size_t hash)
+	{
+		uint64_t probe=hash_table_detail::mix_hash(hash, 0);
+		uint64_t step=hash_table_detail::mix_hash(hash, 0x9e3779b97f4a7c15ULL)|1;
+		bool accu=false;
+
+		for(size_t i=0; i<probes_; ++i, probe+=step)
+		{
+			uint64_t& word=words_[(probe&mask_)/64];
+			uint64_t bit=uint64_t(1)<<(probe%64);
+
+			accu=accu || !(word&bit);
+			word|=bit;
+		}
+
+		return accu;
+	}
+};
+
+}	// namespace sketch_stream_detail
+
+
+// Mergeable summary of the elements ordered by a comparison, answering quantiles within eps*count ranks
+//
+// The sketch keeps levels of fewer than capacity_ elements, an element of
+// level h standing for 2^h elements of the stream. A full level is sorted
+// and compacted: every other element of it, from the first or the second
+// at random, moves up one level and the others are dropped, the odd one
+// out staying. A compaction keeps the total weight and moves the rank of
+// any value by 2^h at most, up or down at random, so the errors of many
+// compactions mostly cancel out: with capacity_ about 2/eps, a quantile is
+// within eps*count ranks of the exact one with high probability, while
+// the sketch holds O(log(eps*count)/eps) elements.
+//
+// Sketches of the same order merge level by level into the sketch of both
+// streams, within the same bound, so partial sketches of substreams, or
+// of chunks folded in parallel, can be combined.
+//
+template <typename T>
+class quantile_sketch
+{
+	std::function<bool (const T&, const T&)> cmp_;
+	double eps_;
+	size_t capacity_;
+	size_t count_;
+	std::vector<std::vector<T>> levels_;
+	uint64_t random_;				// xorshift state choosing the half a compaction keeps
+
+	// Compacts level h into level h+1
+	void compact(size_t h)
+	{
+		if(h+1==levels_.size())
+			levels_.emplace_back();
+
+		std::vector<T>& level=levels_[h];
+		size_t even=level.size()&~size_t(1);
+
+		random_^=random_<<13;
+		random_^=random_>>7;
+		random_^=random_<<17;
+
+		std::sort(level.begin(), level.end(), cmp_);
+
+		for(size_t i=random_&1; i<even; i+=2)
+			levels_[h+1].push_back(std::move(level[i]));
+
+		if(even<level.size())
+		{
+			level[0]=std::move(level.back());
+			level.resize(1);
+		}
+		else
+			level.clear();
+	}
+
+	// Compacts every full level, lowest first
+	void compress()
+	{
+		for(size_t h=0; h<levels_.size(); ++h)
+			if(levels_[h].size()>=capacity_)
+				compact(h);
+	}
+
+	// Gets every element held with its weight, ordered by cmp_
+	std::vector<std::pair<T, size_t>> weighted() const
+	{
+		std::vector<std::pair<T, size_t>> accu;
+
+		for(size_t h=0; h<levels_.size(); ++h)
+			for(const T& value : levels_[h])
+				accu.emplace_back(value, size_t(1)<<h);
+
+		std::sort(accu.begin(), accu.end(), [this](const std::pair<T, size_t>& left, const std::pair<T, size_t>& right) {
+			return cmp_(left.first, right.first);
+			});
+
+		return accu;
+	}
+
+public:
+
+	explicit quantile_sketch(double eps=0.01, const std::function<bool (const T&, const T&)>& cmp=std::less<T>()) :
+	cmp_(cmp),
+	eps_(eps),
+	capacity_(0),
+	count_(0),
+	levels_(1),
+	random_(0x2545f4914f6cdd1dULL)
+	{
+		if(!(eps>0 && eps<1))
+			throw std::invalid_argument("Class: quantile_sketch<>. Quantile error must be in (0, 1).");
+
+		capacity_=std::max(size_t(2), size_t(std::ceil(2/eps)));
+	}
+
+	// Adds value
+	void insert(const T& value)
+	{
+		levels_[0].push_back(value);
+		++count_;
+
+		if(levels_[0].size()>=capacity_)
+			compress();
+	}
+
+	// Adds the elements summarized by other, a sketch of the same eps and order
+	//
+	// The error bound only holds for levels compacted at the same capacity
+	// and sorted by the same comparison. Comparisons are told apart by the
+	// type of their callable, so two stateful comparison objects of one type
+	// are taken as the same order.
+	//
+	void merge(const quantile_sketch<T>& other)
+	{
+		if(other.eps_!=eps_)
+			throw std::invalid_argument("Class: quantile_sketch<>. Cannot merge sketches of different quantile errors.");
+
+		if(other.cmp_.target_type()!=cmp_.target_type())
+			throw std::invalid_argument("Class: quantile_sketch<>. Cannot merge sketches of different orders.");
+
+		std::vector<std::vector<T>> levels(other.levels_);
+
+		if(levels_.size()<levels.size())
+			levels_.resize(levels.size());
+
+		for(size_t h=0; h<levels.size(); ++h)
+			std::move(levels[h].begin(), levels[h].end(), std::back_inserter(levels_[h]));
+
+		count_+=other.count_;
+		random_^=other.random_<<1;
+		compress();
+	}
+
+	// Gets the number of elements added
+	size_t count() const {return count_;}
+
+	// Gets the number of elements held
+	size_t retained() const
+	{
+		size_t accu=0;
+
+		for(const std::vector<T>& level : levels_)
+			accu+=level.size();
+
+		return accu;
+	}
+
+	// Gets the estimated number of elements added less than value
+	size_t rank(const T& value) const
+	{
+		size_t accu=0;
+
+		for(size_t h=0; h<levels_.size(); ++h)
+			for(const T& element : levels_[h])
+				if(cmp_(element, value))
+					accu+=size_t(1)<<h;
+
+		return accu;
+	}
+
+	// Gets the element of estimated rank phi*count, phi in [0, 1]: 0 for the least, 0.5 for the median, 1 for the greatest
+	T quantile(double phi) const
+	{
+		if(!(phi>=0 && phi<=1))
+			throw std::invalid_argument("Class: quantile_sketch<>. Quantile must be in [0, 1].");
+
+		if(count_==0)
+			throw std::range_error("Class: quantile_sketch<>. No quantile of an empty sketch.");
+
+		std::vector<std::pair<T, size_t>> elements=weighted();
+		double target=phi*double(count_);
+		size_t accu=0;
+
+		for(const std::pair<T, size_t>& element : elements)
+		{
+			accu+=element.second;
+
+			if(double(accu)>target)
+				return element.first;
+		}
+
+		return elements.back().first;
+	}
+};
+
+
+namespace sketch_stream_detail
+{
+
+// Streams the elements of position on, adding each to the sketch
+template <typename T>
+lazy_stream<T> sketch_pull(const lazy_stream<T>& position, const std::shared_ptr<quantile_sketch<T>>& sketch_ptr)
+{
+	if(position.empty())
+		return lazy_stream<T>();
+
+	sketch_ptr->insert(position.head());
+
+	return lazy_stream<T>(position.head(), [position, sketch_ptr]() {
+		return sketch_pull(position.tail(), sketch_ptr);
+		});
+}
+
+}	// namespace sketch_stream_detail
+
+
+// Creates the stream of the k greatest elements of source by cmp, greatest first
+//
+// source is read at once, in a single pass keeping the k greatest
+// elements so far in a heap: O(n*log(k)) comparisons and k elements held,
+// whatever the length of source, which must be finite. Equal elements
+// come out in no particular order.
+//
+template <typename T, typename Cmp=std::less<T>>
+lazy_stream<T> top_k(lazy_stream<T> source, size_t k, const Cmp& cmp=Cmp())
+{
+	// On top of the heap, the least of the elements kept
+	auto greater=[&cmp](const T& left, const T& right){return cmp(right, left);};
+	std::vector<T> heap;
+
+	if(k==0)
+		return lazy_stream<T>();
+
+	for(const T& value : std::move(source).consume())
+	{
+		if(heap.size()<k)
+		{
+			heap.push_back(value);
+			std::push_heap(heap.begin(), heap.end(), greater);
+		}
+		else if(cmp(heap.front(), value))
+		{
+			std::pop_heap(heap.begin(), heap.end(), greater);
+			heap.back()=value;
+			std::push_heap(heap.begin(), heap.end(), greater);
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end(), greater);
+
+	return sorted_stream_detail::vector_from(std::make_shared<std::vector<T>>(std::move(heap)), 0);
+}
+
+
+// Creates the substream of the first occurrence of every element of source
+//
+// The elements evaluated so far are kept in an open-addressing hash set,
+// so source is filtered lazily, infinite or not, holding one copy of
+// every distinct element. T must be supported by std::hash and ==.
+//
+template <typename T>
+lazy_stream<T> distinct(lazy_stream<T> source)
+{
+	std::shared_ptr<hash_table<T, bool>> seen_ptr=
+		std::make_shared<hash_table<T, bool>>();
+
+	return std::move(source).filter([seen_ptr](const T& value) {
+		bool inserted;
+
+		seen_ptr->insert(value, true, inserted);
+		return inserted;
+		});
+}
+
+
+// Creates the substream of the first occurrence of every element of source, checked by a Bloom filter
+//
+// The hashes of the elements evaluated so far are set in a Bloom filter
+// sized for expected_count distinct elements and false_positive_rate, so
+// the memory held is fixed up front: about 1.44*log2(1/rate) bits per
+// expected element, rounded up to a power of 2. Repeated elements are
+// always dropped, but a false positive drops a first occurrence too,
+// more often once source goes past expected_count distinct elements.
+// T must be supported by std::hash.
+//
+template <typename T>
+lazy_stream<T> distinct(lazy_stream<T> source, size_t expected_count, double false_positive_rate)
+{
+	std::shared_ptr<sketch_stream_detail::bloom_filter> seen_ptr=
+		std::make_shared<sketch_stream_detail::bloom_filter>(expected_count, false_positive_rate);
+
+	return std::move(source).filter([seen_ptr](const T& value){return seen_ptr->insert(std::hash<T>()(value));});
+}
+
+
+// Gets the quantile sketch of the elements of source ordered by cmp, within eps*size ranks
+//
+// source is read at once, in a single pass holding
+// O(log(eps*size)/eps) elements. It must be finite.
+//
+template <typename T, typename Cmp=std::less<T>>
+quantile_sketch<T> quantiles(lazy_stream<T> source, double eps, const Cmp& cmp=Cmp())
+{
+	quantile_sketch<T> accu(eps, cmp);
+
+	for(const T& value : std::move(source).consume())
+		accu.insert(value);
+
+	return accu;
+}
+
+
+// Creates the stream of the elements of source, adding each to the sketch once evaluated
+//
+// The elements are added to *sketch_ptr in order, as the nodes holding
+// them are evaluated: once the stream is read to some point, the sketch
+// summarizes the elements up to there. The sketch must not be used from
+// another thread meanwhile.
+//
+template <typename T>
+lazy_stream<T> quantiles(lazy_stream<T> source, const std::shared_ptr<quantile_sketch<T>>& sketch_ptr)
+{
+	return sketch_stream_detail::sketch_pull(source, sketch_ptr);
+}
+
+
+#endif
@@ -0,0 +1,90 @@
+// ---------------------------------------------------------
+// - File: sort_benchmark                                  -
+// - External merge sort of a lazy_stream<> ten times      -
+// - larger than its memory budget (Linux)                 -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <sys/resource.h>
+#include "benchmark_timer.h"
+#include "sorted_stream.h"
+
+
+// Peak resident set size of this process so far, in MiB.
+double peak_resident_mib()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_maxrss/1024.0;
+}
+
+
+// A pseudo-random permutation of [0..n), n a power of 2. The temporary
+// range dies here, so that nothing retains the nodes already read.
+lazy_stream<long> scrambled(long n)
+{
+	return lazy_stream<long>::range(0, n).map<long>([n](const long& index){return (index*2654435761L+12345)&(n-1);});
+}
+
+
+int main(int argn, char *argc[])
+{
+	size_t budget=size_t(argn>1 ? std::atol(argc[1]) : 16)<<20;
+	long n=1;
+
+	// 10 times the budget, rounded up to a power of 2
+	while(n*sizeof(long)<10*budget)
+		n*=2;
+
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Budget " << (budget>>20) << "MiB, " << n << " elements ("
+				<< (n*sizeof(long)>>20) << "MiB)" << std::endl;
+
+	double start_mib=peak_resident_mib();
+	long checked=0;
+	long previous=-1;
+
+	// The source is moved into sorted, and the result walked with
+	// for_each_consume: neither is retained.
+	double sorted_ms=time_ms([&](){
+		sorted(scrambled(n), std::less<long>(), budget)
+			.for_each_consume([&](const long& value){
+				if(value!=previous+1)
+					throw std::logic_error("Unsorted stream.");
+
+				previous=value;
+				++checked;
+				});
+		});
+
+	if(checked!=n)
+		throw std::logic_error("Elements lost.");
+
+	std::cout << "sorted:              " << std::setw(9) << sorted_ms << "ms, peak resident +"
+				<< peak_resident_mib()-start_mib << "MiB" << std::endl;
+
+	// In memory, for reference
+	std::vector<long> elements;
+
+	double vector_ms=time_ms([&](){
+		elements.reserve(n);
+		scrambled(n).for_each_consume([&elements](const long& value){elements.push_back(value);});
+		std::sort(elements.begin(), elements.end());
+		});
+
+	std::cout << "to_vector+std::sort: " << std::setw(7) << vector_ms << "ms, peak resident +"
+				<< peak_resident_mib()-start_mib << "MiB" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread sort_benchmark.cpp -o sort_benchmark
@@ -0,0 +1,324 @@
+// ---------------------------------------------------------
+// - External merge sort of lazy_stream<>                  -
+// ---------------------------------------------------------
+
+
+// sorted reads a finite stream into runs that fit a memory budget. A
+// stream within the budget is sorted in memory. Otherwise every run is
+// sorted on a worker thread and written to a spill_file, and the runs are
+// merged back lazily as the sorted stream is read, so a stream far larger
+// than the memory available can be sorted.
+//
+// sorted takes its source stream by value: pass it with std::move, as in
+// sorted(std::move(stream)), so that its nodes are released once read
+// when no other copy of the stream is alive.
+
+
+#ifndef SORTED_STREAM_H
+#define SORTED_STREAM_H
+
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "lazy_stream.h"
+#include "spill_file.h"
+
+
+namespace sorted_stream_detail
+{
+
+// Default memory budget, in bytes
+const size_t default_budget=size_t(64)<<20;
+
+// Most runs merged at once
+const size_t merge_fan_in=64;
+
+// K-way merge of sorted runs spilled to disk
+template <typename T>
+class run_merge
+{
+	// Raw storage for an element read back from disk
+	struct slot_type
+	{
+		alignas(T) unsigned char bytes_[sizeof(T)];
+	};
+
+	// Position in a run, read one block at a time
+	struct reader_type
+	{
+		std::shared_ptr<spill_file> file_ptr_;
+		std::vector<slot_type> block_;
+		size_t next_;
+		size_t size_;
+	};
+
+	std::function<bool (const T&, const T&)> cmp_;
+	std::vector<reader_type> readers_;
+	std::vector<size_t> heap_;			// Readers by current element, least on top
+	size_t block_size_;					// Elements read at once per run
+
+	// Reads the next block of a run. False at its end.
+	bool refill(reader_type& reader)
+	{
+		reader.block_.resize(block_size_);
+		reader.size_=reader.file_ptr_->read(reader.block_.data(), block_size_*sizeof(T))/sizeof(T);
+		reader.next_=0;
+
+		if(reader.size_<1)
+		{
+			reader.block_=std::vector<slot_type>();
+			reader.file_ptr_.reset();	// The run file is removed as soon as it is read
+		}
+
+		return reader.size_>0;
+	}
+
+	// Gets the current element of reader i
+	const T* head(size_t i) const
+	{
+		return reinterpret_cast<const T*>(&readers_[i].block_[readers_[i].next_]);
+	}
+
+	// Does the current element of reader a go after that of reader b? Ties go to the earlier run.
+	bool after(size_t a, size_t b) const
+	{
+		if(cmp_(*head(b), *head(a)))
+			return true;
+
+		return !cmp_(*head(a), *head(b)) && b<a;
+	}
+
+	// Adds reader i to the heap
+	void push(size_t i)
+	{
+		heap_.push_back(i);
+		std::push_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b){return after(a, b);});
+	}
+
+public:
+
+	// Opens the merge of runs, reading them in blocks that share memory_budget bytes
+	run_merge(const std::vector<std::shared_ptr<spill_file>>& runs, const std::function<bool (const T&, const T&)>& cmp,
+		size_t memory_budget) :
+	cmp_(cmp),
+	readers_(runs.size()),
+	block_size_(std::max(size_t(1), memory_budget/sizeof(T)/std::max(size_t(1), runs.size())))
+	{
+		for(size_t i=0; i<runs.size(); ++i)
+		{
+			readers_[i].file_ptr_=runs[i];
+			readers_[i].next_=0;
+			readers_[i].size_=0;
+
+			if(refill(readers_[i]))
+				push(i);
+		}
+	}
+
+	// Gets the least element, or nullptr once the runs are exhausted
+	const T* top() const
+	{
+		return heap_.empty() ? nullptr : head(heap_.front());
+	}
+
+	// Moves past the least element
+	void pop()
+	{
+		size_t i=heap_.front();
+
+		std::pop_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b){return after(a, b);});
+		heap_.pop_back();
+
+		if(++readers_[i].next_<readers_[i].size_ || refill(readers_[i]))
+			push(i);
+	}
+};
+
+// Streams the elements of a vector from index on, sharing it
+template <typename T>
+lazy_stream<T> vector_from(const std::shared_ptr<std::vector<T>>& vector_ptr, size_t index)
+{
+	if(index>=vector_ptr->size())
+		return lazy_stream<T>();
+
+	return lazy_stream<T>::from_shared(std::shared_ptr<T>(vector_ptr, &(*vector_ptr)[index]), [vector_ptr, index]() {
+		return vector_from(vector_ptr, index+1);
+		});
+}
+
+// Streams the merged elements
+template <typename T>
+lazy_stream<T> merge_pull(const std::shared_ptr<run_merge<T>>& merge_ptr)
+{
+	const T* value=merge_ptr->top();
+
+	if(!value)
+		return lazy_stream<T>();
+
+	lazy_stream<T> accu(*value, [merge_ptr]() {
+		return merge_pull(merge_ptr);
+		});
+
+	merge_ptr->pop();
+
+	return accu;
+}
+
+// Sorts the elements of source, spilling runs to disk if needed
+template <typename T>
+lazy_stream<T> sort_from(lazy_stream<T> source, const std::function<bool (const T&, const T&)>& cmp,
+	size_t memory_budget)
+{
+	// One run being read plus one per worker fill the budget
+	size_t workers=std::max(1u, std::thread::hardware_concurrency());
+	size_t run_size=std::max(size_t(1), memory_budget/sizeof(T)/(workers+1));
+
+	std::vector<T> run;
+	std::deque<std::future<std::shared_ptr<spill_file>>> pending;
+	std::vector<std::shared_ptr<spill_file>> runs;
+	std::vector<size_t> levels;		// Number of merges each run went through
+
+	// Merges runs [first..last) into a new one
+	auto merge_runs=[&](size_t first, size_t last) -> std::shared_ptr<spill_file> {
+		run_merge<T> merge(std::vector<std::shared_ptr<spill_file>>(runs.begin()+first, runs.begin()+last),
+			cmp, memory_budget/2);
+		std::shared_ptr<spill_file> file_ptr=std::make_shared<spill_file>();
+		std::vector<T> block;
+
+		block.reserve(std::max(size_t(1), memory_budget/2/sizeof(T)));
+
+		for(; merge.top(); merge.pop())
+		{
+			block.push_back(*merge.top());
+
+			if(block.size()==block.capacity())
+			{
+				file_ptr->write(block.data(), block.size()*sizeof(T));
+				block.clear();
+			}
+		}
+
+		file_ptr->write(block.data(), block.size()*sizeof(T));
+		file_ptr->rewind();
+		return file_ptr;
+	};
+
+	// Adds a sorted run. As in a binary counter, every merge_fan_in runs
+	// of a level are merged into one of the next level, which bounds the
+	// number of open files; the merged runs are the last ones, consecutive,
+	// so the sort stays stable.
+	auto add_run=[&](const std::shared_ptr<spill_file>& file_ptr) {
+		runs.push_back(file_ptr);
+		levels.push_back(0);
+
+		while(runs.size()>=merge_fan_in &&
+			levels[runs.size()-merge_fan_in]==levels.back())
+		{
+			size_t first=runs.size()-merge_fan_in;
+			size_t level=levels.back()+1;
+			std::shared_ptr<spill_file> merged_ptr=merge_runs(first, runs.size());
+
+			runs.resize(first);
+			levels.resize(first);
+			runs.push_back(merged_ptr);
+			levels.push_back(level);
+		}
+	};
+
+	auto spill=[&]() {
+		if(!std::is_trivially_copyable<T>::value)
+			throw std::length_error("Function: sorted. Elements over the sort budget cannot be spilled to disk.");
+
+		if(pending.size()>=workers)
+		{
+			add_run(pending.front().get());
+			pending.pop_front();
+		}
+
+		pending.push_back(std::async(std::launch::async, [cmp](std::vector<T> elements) {
+			std::stable_sort(elements.begin(), elements.end(), cmp);
+
+			std::shared_ptr<spill_file> file_ptr=std::make_shared<spill_file>();
+
+			file_ptr->write(elements.data(), elements.size()*sizeof(T));
+			file_ptr->rewind();
+			return file_ptr;
+			}, std::move(run)));
+
+		run=std::vector<T>();
+	};
+
+	run.reserve(std::min(run_size, size_t(1)<<16));
+
+	// A full run is spilled once another element follows it, so a stream
+	// of exactly one run is still sorted in memory
+	for(const T& value : std::move(source).consume())
+	{
+		if(run.size()>=run_size)
+			spill();
+
+		run.push_back(value);
+	}
+
+	if(pending.empty() && runs.empty())
+	{
+		std::stable_sort(run.begin(), run.end(), cmp);
+
+		return vector_from(std::make_shared<std::vector<T>>(std::move(run)), 0);
+	}
+
+	if(!run.empty())
+		spill();
+
+	for(; !pending.empty(); pending.pop_front())
+		add_run(pending.front().get());
+
+	// Merges groups of consecutive runs until few enough are left
+	while(runs.size()>merge_fan_in)
+	{
+		std::vector<std::shared_ptr<spill_file>> merged;
+
+		for(size_t first=0; first<runs.size(); first+=merge_fan_in)
+			merged.push_back(merge_runs(first, std::min(first+merge_fan_in, runs.size())));
+
+		runs.swap(merged);
+	}
+
+	return merge_pull(std::make_shared<run_merge<T>>(runs, cmp, memory_budget));
+}
+
+}	// namespace sorted_stream_detail
+
+
+// Creates the stream of the elements of source ordered by cmp, spilling sorted runs to disk beyond memory_budget bytes
+//
+// The elements are read into runs of at most memory_budget bytes in all,
+// counted as sizeof(T) per element. When the whole stream fits, it is
+// sorted in memory. Otherwise every full run is sorted and written to a
+// spill_file on a worker thread, up to one worker per hardware thread,
+// while the next run is read; the runs are then merged back lazily, each
+// one read sequentially in blocks, as elements are forced. The sort is
+// stable.
+//
+// Spilled elements are written as raw bytes, so spilling needs trivially
+// copyable elements: for any other type a stream over the budget throws
+// std::length_error. source must be finite.
+//
+template <typename T, typename Cmp=std::less<T>>
+lazy_stream<T> sorted(lazy_stream<T> source, const Cmp& cmp=Cmp(),
+	size_t memory_budget=sorted_stream_detail::default_budget)
+{
+	return sorted_stream_detail::sort_from<T>(std::move(source), cmp, memory_budget);
+}
+
+
+#endif
@@ -0,0 +1,70 @@
+// ---------------------------------------------------------
+// - Class: spill_file                                     -
+// - Anonymous temporary file for elements spilled to disk -
+// ---------------------------------------------------------
+
+
+// sorted writes its sorted runs, and group_by and hash_join their
+// partitions, to spill files once their input exceeds a memory budget.
+// The file has no name, and is removed by the system once closed, even
+// if the program dies first.
+
+
+#ifndef SPILL_FILE_H
+#define SPILL_FILE_H
+
+
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+
+
+// Anonymous temporary file, removed once closed, holding elements spilled to disk
+class spill_file
+{
+	std::FILE* file_;
+
+public:
+
+	// Creates the file
+	spill_file() :
+	file_(std::tmpfile())
+	{
+		if(!file_)
+			throw std::runtime_error("Class: spill_file. Cannot create a temporary file.");
+	}
+
+	spill_file(const spill_file&)=delete;
+	spill_file& operator=(const spill_file&)=delete;
+
+	// Closes and so removes the file
+	~spill_file() {std::fclose(file_);}
+
+	// Appends bytes bytes
+	void write(const void* data, size_t bytes)
+	{
+		if(bytes>0 && std::fwrite(data, 1, bytes, file_)!=bytes)
+			throw std::runtime_error("Class: spill_file. Cannot write a temporary file.");
+	}
+
+	// Goes back to the start, for reading
+	void rewind()
+	{
+		if(std::fflush(file_)!=0 || std::fseek(file_, 0, SEEK_SET)!=0)
+			throw std::runtime_error("Class: spill_file. Cannot rewind a temporary file.");
+	}
+
+	// Reads up to bytes bytes. Returns the number read, less at the end.
+	size_t read(void* data, size_t bytes)
+	{
+		size_t accu=std::fread(data, 1, bytes, file_);
+
+		if(accu<bytes && std::ferror(file_))
+			throw std::runtime_error("Class: spill_file. Cannot read a temporary file.");
+
+		return accu;
+	}
+};
+
+
+#endif
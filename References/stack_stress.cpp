@@ -0,0 +1,141 @@
+// ---------------------------------------------------------
+// - File: stack_stress                                    -
+// - Very long lazy_stream<> traversals and destructions   -
+// - in constant stack                                     -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include "benchmark_timer.h"
+#include "lazy_stream.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// Runs test and prints its wall time.
+void timed(const char* name, const std::function<void ()>& test)
+{
+	std::cout << name << ": " << time_ms(test) << "ms" << std::endl;
+}
+
+
+// The multiples of every in [0..n), one filter step per rejected run.
+//
+// Built apart so that no temporary keeps the head of the filtered stream
+// alive while the result is consumed.
+lazy_stream<long> sparse(long n, long every)
+{
+	std::function<bool (const long&)> multiple=[every](const long& value){return value%every==every-1;};
+
+	return lazy_stream<long>::range(0, n).filter(multiple);
+}
+
+
+// [0..n) through an identity map.
+//
+// Unlike range, a mapped stream has no closed form: get, contains, drop
+// and size walk every node of it, and holding it memoizes the whole chain.
+lazy_stream<long> walked(long n)
+{
+	std::function<long (const long&)> identity=[](const long& value){return value;};
+
+	return lazy_stream<long>::range(0, n).map(identity);
+}
+
+
+int main(int argn, char *argc[])
+{
+	// Consumed and temporary streams are released as they go, so they can be very long.
+	// Held streams keep every memoized node, ~200 bytes each.
+	long n=argn>1 ? std::atol(argc[1]) : 100000000L;
+	long held=argn>2 ? std::atol(argc[2]) : 10000000L;
+
+	timed("filter, 10 survivors out of n", [n](){
+		long count=0;
+
+		sparse(n, n/10).for_each_consume([&count](const long&){++count;});
+
+		expect(count==10, "sparse filter");
+		});
+
+	timed("filter, no survivor out of n", [n](){
+		expect(sparse(n, n+1).empty(), "empty filter");
+		});
+
+	timed("filter of filter, consumed", [n](){
+		std::function<bool (const long&)> odd=[](const long& value){return value%2==1;};
+		long count=0;
+
+		sparse(n, 1000).filter(odd).for_each_consume([&count](const long&){++count;});
+
+		expect(count==n/1000, "nested filter");
+		});
+
+	timed("drop, drop_while of a temporary", [n](){
+		std::function<bool (const long&)> below=[n](const long& value){return value<n-1;};
+
+		expect(walked(n).drop(n-1).head()==n-1, "drop");
+		expect(walked(n).drop_while(below).head()==n-1, "drop_while");
+		});
+
+	timed("contains, exists, get, find_first on a held stream", [held](){
+		lazy_stream<long> stream=walked(held);
+		std::function<bool (const long&)> last=[held](const long& value){return value==held-1;};
+
+		expect(stream.contains(held-1), "contains");
+		expect(!stream.contains(held), "does not contain");
+		expect(stream.exists(last), "exists");
+		expect(stream.get(held-1)==held-1, "get");
+		expect(stream.find_first(last).head()==held-1, "find_first");
+		});
+
+	timed("drop, drop_while on a held stream", [held](){
+		lazy_stream<long> stream=walked(held);
+		std::function<bool (const long&)> below=[held](const long& value){return value<held-1;};
+
+		expect(stream.drop(held-1).head()==held-1, "drop");
+		expect(stream.drop(held+1).empty(), "drop past the end");
+		expect(stream.drop_while(below).head()==held-1, "drop_while");
+		});
+
+	timed("unzip of a held stream", [held](){
+		std::function<std::pair<long, long> (const long&)> twice=
+			[](const long& value){return std::make_pair(value, 2*value);};
+		std::pair<lazy_stream<long>, lazy_stream<long>> halves=unzip(
+			lazy_stream<long>::range(0, held).map(twice));
+
+		expect(halves.first.get(held-1)==held-1, "unzip first");
+		expect(halves.second.get(held-1)==2*(held-1), "unzip second");
+		});
+
+	timed("destruction of a memoized chain", [held](){
+		lazy_stream<long> stream=walked(held);
+
+		expect(stream.size()==size_t(held), "size");
+		});
+
+	timed("destruction of a cons chain", [held](){
+		lazy_stream<long> stream=lazy_stream<long>::range(0, held).reverse();
+
+		expect(stream.head()==held-1, "reverse");
+		});
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread stack_stress.cpp -o stack_stress
@@ -0,0 +1,63 @@
+// ---------------------------------------------------------
+// - File: static_benchmark                                -
+// - map+filter+fold on lazy_stream<>, fused_stream<> and  -
+// - static_stream<>                                       -
+// ---------------------------------------------------------
+
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include "benchmark_timer.h"
+#include "fused_stream.h"
+#include "lazy_stream.h"
+#include "static_stream.h"
+
+
+// Prints the time per element of fn over n elements.
+template <typename F>
+void report(const char* name, long n, F fn)
+{
+	long sum=0;
+	double ms=time_ms([&](){sum=fn();});
+
+	std::cout << std::setw(14) << name << "(" << n << "): "
+				<< std::setw(10) << ms << "ms, "
+				<< std::setw(9) << 1e6*ms/n << "ns/elem (sum " << sum << ")" << std::endl;
+}
+
+
+int main(int argn, char *argc[])
+{
+	long n=argn>1 ? std::atol(argc[1]) : 100000;
+
+	std::function<long (const long&)> triple=[](const long& value){return value*3;};
+	std::function<bool (const long&)> even=[](const long& value){return value%2==0;};
+	std::function<long (const long&, const long&)> add=[](const long& accu, const long& value){
+		return accu+value;
+		};
+
+	std::cout << std::fixed << std::setprecision(3);
+
+	report("lazy_stream", n, [&](){
+		return lazy_stream<long>::range(0, n).map(triple).filter(even).fold_left<long>(0)(add);
+		});
+
+	report("fused_stream", n, [&](){
+		return fused_stream<long>::range(0, n).map(triple).filter(even).fold_left<long>(0)(add);
+		});
+
+	// The same lambdas, but their types stay visible to the compiler.
+	for(long m=n; m<=100*n; m*=10)
+		report("static_stream", m, [m](){
+			return static_range(0L, m)
+						.map([](long value){return value*3;})
+						.filter([](long value){return value%2==0;})
+						.fold_left(0L, [](long accu, long value){return accu+value;});
+			});
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread static_benchmark.cpp -o static_benchmark
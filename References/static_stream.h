@@ -0,0 +1,282 @@
+// ---------------------------------------------------------
+// - Class: static_stream<>                                -
+// - Statically typed pull-based stream without            -
+// - std::function erasure                                 -
+// ---------------------------------------------------------
+
+
+// lazy_stream<> and fused_stream<> erase every generator, map function and
+// predicate through std::function. static_stream<T, Gen> keeps the type of
+// every stage instead: Gen is a generator object with the signature
+//
+// bool operator()(T& value);
+//
+// which pulls the next element into value and returns false at the end.
+// Each operator wraps the generator of the previous stage by value in a new
+// generator type (the stages of step_gen.h), so the whole chain is one
+// object the compiler can see through, inline and vectorize. Copying a static_stream<> copies the chain
+// state, so every consumer below starts from a fresh copy and the stream
+// itself is never consumed.
+//
+// Use to_lazy_stream() (or an explicit cast) when type erasure is needed.
+//
+// T must be default constructible.
+
+
+#ifndef STATIC_STREAM_H
+#define STATIC_STREAM_H
+
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include "lazy_stream.h"
+#include "step_gen.h"
+
+
+template <typename T, typename Gen>
+class static_stream
+{
+	Gen gen_;
+
+	// Lazily pulls the rest of a run into a stream
+	static lazy_stream<T> pull(const std::shared_ptr<Gen>& gen_ptr);
+
+public:
+
+	typedef T value_type;
+	typedef Gen generator_type;
+
+	// Creates a stream from its generator
+	explicit static_stream(const Gen& gen) :
+	gen_(gen) {}
+
+	// Is the stream empty?
+	bool empty() const;
+
+	// Gets the stream first element (head)
+	T head() const;
+
+	// Gets the element of index n [0..)
+	T get(size_t n) const;
+
+	// Gets the number of elements in the stream
+	size_t size() const;
+
+	// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+	template <typename Pred>
+	static_stream<T, step_gen_detail::filter_gen<Gen, Pred, T>> filter(const Pred& filter_fn) const;
+
+	// Creates the substream of the first n elements
+	static_stream<T, step_gen_detail::take_gen<Gen, T>> take(size_t n) const;
+
+	// Creates the substream resulting from dropping the first n elements
+	static_stream<T, step_gen_detail::drop_gen<Gen, T>> drop(size_t n) const;
+
+	// Creates a stream by applying the map_fn map
+	template <typename F, typename U=step_gen_detail::map_result<F, T>>
+	static_stream<U, step_gen_detail::map_gen<Gen, F, T, U>> map(const F& map_fn) const;
+
+	// Fold left reduction with fold_fn: (U, T) => U
+	template <typename U, typename F>
+	U fold_left(const U& start, F fold_fn) const;
+
+	// Pours the stream into a std::list
+	std::list<T> to_list() const;
+
+	// Runs the stream as a type-erased lazy stream, pulling each element on demand
+	lazy_stream<T> to_lazy_stream() const;
+
+	// Explicit conversion to a type-erased lazy stream
+	explicit operator lazy_stream<T>() const {return to_lazy_stream();}
+};
+
+
+// Creates the stream: {n, n+step, n+2*step,...}, step 1 by default
+template <typename T>
+static_stream<T, step_gen_detail::from_gen<T>> static_from(const T& n, const T& step=T(1))
+{
+	return static_stream<T, step_gen_detail::from_gen<T>>(
+		step_gen_detail::from_gen<T>{n, step});
+}
+
+
+// Creates the stream: [from..to) with a step
+template <typename T>
+static_stream<T, step_gen_detail::range_gen<T>> static_range(const T& from, const T& to, const T& step)
+{
+	return static_stream<T, step_gen_detail::range_gen<T>>(
+		step_gen_detail::range_gen<T>{from, to, step});
+}
+
+
+// Creates the stream: [from..to)
+template <typename T>
+static_stream<T, step_gen_detail::range_gen<T>> static_range(const T& from, const T& to)
+{
+	return static_range(from, to, to<from ? T(-1) : T(1));
+}
+
+
+// Creates a stream pulling its elements from a lazy stream
+template <typename T>
+static_stream<T, step_gen_detail::lazy_gen<T>> static_of(const lazy_stream<T>& stream)
+{
+	return static_stream<T, step_gen_detail::lazy_gen<T>>(
+		step_gen_detail::lazy_gen<T>{stream});
+}
+
+
+// Is the stream empty?
+template <typename T, typename Gen>
+bool static_stream<T, Gen>::empty() const
+{
+	Gen gen=gen_;
+	T value=T();
+
+	return !gen(value);
+}
+
+
+// Gets the stream first element (head)
+template <typename T, typename Gen>
+T static_stream<T, Gen>::head() const
+{
+	Gen gen=gen_;
+	T value=T();
+
+	if(!gen(value))
+		throw std::range_error("Class: static_stream<>. No head in empty stream.");
+
+	return value;
+}
+
+
+// Gets the element of index n [0..)
+template <typename T, typename Gen>
+T static_stream<T, Gen>::get(size_t n) const
+{
+	Gen gen=gen_;
+	T value=T();
+
+	for(size_t i=0; i<=n; ++i)
+		if(!gen(value))
+			throw std::range_error("Class: static_stream<>. Index out of range.");
+
+	return value;
+}
+
+
+// Gets the number of elements in the stream
+template <typename T, typename Gen>
+size_t static_stream<T, Gen>::size() const
+{
+	Gen gen=gen_;
+	T value=T();
+	size_t accu=0;
+
+	while(gen(value))
+		++accu;
+
+	return accu;
+}
+
+
+// Creates a substream by selecting all the elements which satisfy the filter_fn predicate
+template <typename T, typename Gen>
+template <typename Pred>
+static_stream<T, step_gen_detail::filter_gen<Gen, Pred, T>> static_stream<T, Gen>::filter(const Pred& filter_fn) const
+{
+	return static_stream<T, step_gen_detail::filter_gen<Gen, Pred, T>>(
+		step_gen_detail::filter_gen<Gen, Pred, T>{gen_, filter_fn});
+}
+
+
+// Creates the substream of the first n elements
+template <typename T, typename Gen>
+static_stream<T, step_gen_detail::take_gen<Gen, T>> static_stream<T, Gen>::take(size_t n) const
+{
+	return static_stream<T, step_gen_detail::take_gen<Gen, T>>(
+		step_gen_detail::take_gen<Gen, T>{gen_, n});
+}
+
+
+// Creates the substream resulting from dropping the first n elements
+template <typename T, typename Gen>
+static_stream<T, step_gen_detail::drop_gen<Gen, T>> static_stream<T, Gen>::drop(size_t n) const
+{
+	return static_stream<T, step_gen_detail::drop_gen<Gen, T>>(
+		step_gen_detail::drop_gen<Gen, T>{gen_, n});
+}
+
+
+// Creates a stream by applying the map_fn map
+template <typename T, typename Gen>
+template <typename F, typename U>
+static_stream<U, step_gen_detail::map_gen<Gen, F, T, U>> static_stream<T, Gen>::map(const F& map_fn) const
+{
+	return static_stream<U, step_gen_detail::map_gen<Gen, F, T, U>>(
+		step_gen_detail::map_gen<Gen, F, T, U>{gen_, map_fn, T()});
+}
+
+
+// Fold left reduction
+//
+// Same sequence as lazy_stream<>::fold_left.
+//
+template <typename T, typename Gen>
+template <typename U, typename F>
+U static_stream<T, Gen>::fold_left(const U& start, F fold_fn) const
+{
+	Gen gen=gen_;
+	T value=T();
+	U accu=start;
+
+	while(gen(value))
+		accu=fold_fn(accu, static_cast<const T&>(value));
+
+	return accu;
+}
+
+
+// Pours the stream into a std::list
+template <typename T, typename Gen>
+std::list<T> static_stream<T, Gen>::to_list() const
+{
+	Gen gen=gen_;
+	T value=T();
+	std::list<T> accu;
+
+	while(gen(value))
+		accu.push_back(value);
+
+	return accu;
+}
+
+
+// Runs the stream as a type-erased lazy stream, pulling each element on demand
+template <typename T, typename Gen>
+lazy_stream<T> static_stream<T, Gen>::to_lazy_stream() const
+{
+	return pull(std::make_shared<Gen>(gen_));
+}
+
+
+// Lazily pulls the rest of a run into a stream
+template <typename T, typename Gen>
+lazy_stream<T> static_stream<T, Gen>::pull(const std::shared_ptr<Gen>& gen_ptr)
+{
+	T value=T();
+
+	if(!(*gen_ptr)(value))
+		return lazy_stream<T>();
+
+	return lazy_stream<T>(std::move(value), [gen_ptr]() -> lazy_stream<T> {
+		return static_stream<T, Gen>::pull(gen_ptr);
+		});
+}
+
+
+#endif
@@ -0,0 +1,188 @@
+// ---------------------------------------------------------
+// - Generators: from_gen<>, range_gen<>, filter_gen<>,... -
+// - Pull stages shared by fused, static and once streams  -
+// ---------------------------------------------------------
+
+
+// fused_stream<>, static_stream<> and once_stream<> all run a pipeline as a
+// chain of generators with the signature
+//
+// bool operator()(T& value);
+//
+// which pulls the next element into value and returns false at the end.
+// The stages below are the generators of that chain, written once for the
+// three of them. Each stage holds the generator of the stage before it by
+// value, as a type parameter: static_stream<> instantiates them on the
+// concrete types of the chain, while fused_stream<> and once_stream<>
+// instantiate them on std::function and erase every stage. What differs
+// between the streams is only how a chain is owned and run (a fresh copy
+// per run, or a single consuming pass), which stays in their own headers.
+//
+// T must be default constructible.
+
+
+#ifndef STEP_GEN_H
+#define STEP_GEN_H
+
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include "lazy_stream.h"
+
+
+namespace step_gen_detail
+{
+
+// Generator of {n, n+step, n+2*step,...}
+template <typename T>
+struct from_gen
+{
+	T next_;
+	T step_;
+
+	bool operator()(T& value)
+	{
+		value=next_;
+		next_+=step_;
+		return true;
+	}
+};
+
+// Generator of [from..to) with a step
+template <typename T>
+struct range_gen
+{
+	T next_;
+	T to_;
+	T step_;
+
+	bool operator()(T& value)
+	{
+		if(!((to_>next_ && step_>=T(0)) || (next_>to_ && step_<=T(0))))
+			return false;
+
+		value=next_;
+		next_+=step_;
+		return true;
+	}
+};
+
+// Generator pulling from a lazy_stream<>, releasing each node once passed
+template <typename T>
+struct lazy_gen
+{
+	lazy_stream<T> next_;
+
+	bool operator()(T& value)
+	{
+		if(next_.empty())
+			return false;
+
+		value=*next_.head_ptr_;
+		next_=next_.tail();
+		return true;
+	}
+};
+
+// Generator keeping the elements which satisfy Pred
+template <typename Gen, typename Pred, typename T>
+struct filter_gen
+{
+	Gen gen_;
+	Pred filter_fn_;
+
+	bool operator()(T& value)
+	{
+		while(gen_(value))
+			if(filter_fn_(static_cast<const T&>(value)))
+				return true;
+
+		return false;
+	}
+};
+
+// Generator applying F to every element of type T
+template <typename Gen, typename F, typename T, typename U>
+struct map_gen
+{
+	Gen gen_;
+	F map_fn_;
+	T input_;
+
+	bool operator()(U& value)
+	{
+		if(!gen_(input_))
+			return false;
+
+		value=map_fn_(static_cast<const T&>(input_));
+		return true;
+	}
+};
+
+// Generator of the first n elements
+template <typename Gen, typename T>
+struct take_gen
+{
+	Gen gen_;
+	size_t left_;
+
+	bool operator()(T& value)
+	{
+		if(left_<1 || !gen_(value))
+			return false;
+
+		--left_;
+		return true;
+	}
+};
+
+// Generator dropping the first n elements
+template <typename Gen, typename T>
+struct drop_gen
+{
+	Gen gen_;
+	size_t left_;
+
+	bool operator()(T& value)
+	{
+		for(; left_>0; --left_)
+			if(!gen_(value))
+				return false;
+
+		return gen_(value);
+	}
+};
+
+// Generator dropping the elements up to the first one which does not satisfy Pred
+template <typename Gen, typename Pred, typename T>
+struct drop_while_gen
+{
+	Gen gen_;
+	Pred drop_fn_;
+	bool dropping_;
+
+	bool operator()(T& value)
+	{
+		if(!dropping_)
+			return gen_(value);
+
+		while(gen_(value))
+			if(!drop_fn_(static_cast<const T&>(value)))
+			{
+				dropping_=false;
+				return true;
+			}
+
+		return false;
+	}
+};
+
+// Result type of map_fn applied to const T&
+template <typename F, typename T>
+using map_result=typename std::decay<decltype(std::declval<F&>()(std::declval<const T&>()))>::type;
+
+}	// namespace step_gen_detail
+
+
+#endif
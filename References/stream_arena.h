@@ -0,0 +1,209 @@
+// ---------------------------------------------------------
+// - Class: stream_arena                                   -
+// - Per-thread bump arena for lazy_stream<> nodes         -
+// ---------------------------------------------------------
+
+
+// lazy_stream<> allocates its heads, tails and tail cells through
+// stream_allocator<>. With no arena installed that is the ordinary heap.
+// Constructing a stream_arena installs it as the current arena of the
+// calling thread: from then on the nodes created by this thread are bump
+// allocated from its blocks. Small blocks freed on the same thread while the
+// arena is current go to per-size free lists and are reused, which keeps
+// the working set of short-lived streams hot in cache; anything else is
+// only reclaimed in bulk. Destroying the arena uninstalls it and releases
+// all its blocks at once, e.g. when a request finishes.
+//
+// Every node allocated from an arena must be destroyed before the arena.
+// Arenas nest, and must be destroyed in reverse order on the thread that
+// created them. A memoized tail goes to the arena of the node it is forced
+// from, whatever arena is current at the time: a stream built on the heap
+// and walked within an arena scope stays on the heap, and outlives the
+// arena. A node forced on another thread than the one owning its arena
+// (prefetch, concurrent forcing) gets its tail from the heap. The closures
+// held by std::function generators are not covered: std::function has no
+// allocator support.
+
+
+#ifndef STREAM_ARENA_H
+#define STREAM_ARENA_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+
+class stream_arena
+{
+	// Free lists cover the sizes up to pool_classes*pool_granularity bytes
+	static const size_t pool_granularity=16;
+	static const size_t pool_classes=16;
+
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	void* free_lists_[pool_classes];	// Freed blocks, linked through their first word
+	char* next_;					// Next free byte in the last block
+	size_t left_;					// Free bytes in the last block
+	size_t block_size_;
+	size_t capacity_;
+	stream_arena* previous_;		// Arena installed before this one
+	std::thread::id owner_;			// Thread that created the arena
+
+public:
+
+	// Default size of an arena block
+	static const size_t default_block_size=64*1024;
+
+	// Creates an arena and installs it as the current one of this thread
+	explicit stream_arena(size_t block_size=default_block_size) :
+	next_(nullptr),
+	left_(0),
+	block_size_(block_size),
+	capacity_(0),
+	previous_(current()),
+	owner_(std::this_thread::get_id())
+	{
+		for(size_t i=0; i<pool_classes; ++i)
+			free_lists_[i]=nullptr;
+
+		current()=this;
+	}
+
+	stream_arena(const stream_arena&)=delete;
+	stream_arena& operator=(const stream_arena&)=delete;
+
+	// Uninstalls the arena and releases all its blocks
+	~stream_arena()
+	{
+		current()=previous_;
+	}
+
+	// Gets the current arena of this thread, null if none
+	static stream_arena*& current()
+	{
+		static thread_local stream_arena* arena=nullptr;
+
+		return arena;
+	}
+
+	// Is the arena owned by this thread, the only one that may allocate from it?
+	bool owned_here() const {return owner_==std::this_thread::get_id();}
+
+	// Allocates size bytes aligned to alignment
+	void* allocate(size_t size, size_t alignment);
+
+	// Gives back a block of size bytes aligned to alignment
+	void deallocate(void* ptr, size_t size, size_t alignment);
+
+	// Gets the number of bytes reserved in blocks
+	size_t capacity() const {return capacity_;}
+};
+
+
+// Allocator of lazy_stream<> nodes from the current arena, or the heap
+template <typename T>
+struct stream_allocator
+{
+	typedef T value_type;
+
+	stream_arena* arena_;	// Arena current at construction, null for the heap
+
+	stream_allocator() :
+	arena_(stream_arena::current()) {}
+
+	template <typename U>
+	stream_allocator(const stream_allocator<U>& other) :
+	arena_(other.arena_) {}
+
+	T* allocate(size_t n)
+	{
+		if(arena_)
+			return static_cast<T*>(arena_->allocate(n*sizeof(T), alignof(T)));
+
+		return static_cast<T*>(::operator new(n*sizeof(T)));
+	}
+
+	void deallocate(T* ptr, size_t n)
+	{
+		if(arena_)
+			arena_->deallocate(ptr, n*sizeof(T), alignof(T));
+		else
+			::operator delete(ptr);
+	}
+};
+
+
+template <typename T, typename U>
+bool operator==(const stream_allocator<T>& a, const stream_allocator<U>& b)
+{
+	return a.arena_==b.arena_;
+}
+
+
+template <typename T, typename U>
+bool operator!=(const stream_allocator<T>& a, const stream_allocator<U>& b)
+{
+	return a.arena_!=b.arena_;
+}
+
+
+// Allocates size bytes aligned to alignment
+inline void* stream_arena::allocate(size_t size, size_t alignment)
+{
+	if(size<=pool_classes*pool_granularity && alignment<=pool_granularity)
+	{
+		size_t index=size ? (size-1)/pool_granularity : 0;
+
+		if(void* ptr=free_lists_[index])
+		{
+			free_lists_[index]=*static_cast<void**>(ptr);
+			return ptr;
+		}
+
+		size=(index+1)*pool_granularity;	// Reusable by any block of its class
+		alignment=pool_granularity;
+	}
+
+	size_t padding=(alignment-reinterpret_cast<uintptr_t>(next_)%alignment)%alignment;
+
+	if(padding+size>left_)
+	{
+		// Oversized requests get a block of their own
+		size_t block_size=size+alignment>block_size_ ? size+alignment : block_size_;
+
+		blocks_.emplace_back(new char[block_size]);
+		next_=blocks_.back().get();
+		left_=block_size;
+		capacity_+=block_size;
+		padding=(alignment-reinterpret_cast<uintptr_t>(next_)%alignment)%alignment;
+	}
+
+	void* ptr=next_+padding;
+	next_+=padding+size;
+	left_-=padding+size;
+
+	return ptr;
+}
+
+
+// Gives back a block of size bytes aligned to alignment
+//
+// Only the owning thread, while this arena is its current one, may touch the
+// free lists. Blocks freed elsewhere, and large ones, wait for the bulk release.
+//
+inline void stream_arena::deallocate(void* ptr, size_t size, size_t alignment)
+{
+	if(current()!=this || size>pool_classes*pool_granularity || alignment>pool_granularity)
+		return;
+
+	size_t index=size ? (size-1)/pool_granularity : 0;
+
+	*static_cast<void**>(ptr)=free_lists_[index];
+	free_lists_[index]=ptr;
+}
+
+
+#endif
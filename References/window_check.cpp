@@ -0,0 +1,145 @@
+// ---------------------------------------------------------
+// - File: window_check                                    -
+// - chunk, sliding and batch_by against blocks cut from   -
+// - a std::vector                                         -
+// ---------------------------------------------------------
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "lazy_stream.h"
+
+
+// Fails unless condition holds.
+void expect(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		std::cout << "FAILED: " << what << std::endl;
+		std::exit(1);
+	}
+}
+
+
+// Fails unless test throws an E.
+template <typename E>
+void expect_throw(const std::function<void ()>& test, const char* what)
+{
+	try
+	{
+		test();
+	}
+	catch(const E&)
+	{
+		return;
+	}
+	catch(...)
+	{
+	}
+
+	expect(false, what);
+}
+
+
+// [0..n) through a map, so that no closed form is taken, with runs of equal elements.
+lazy_stream<long> runs(long n)
+{
+	std::function<long (const long&)> run=[](const long& value){return value/3+value/7;};
+
+	return lazy_stream<long>::range(0, n).map(run);
+}
+
+
+// The blocks of n consecutive elements of elements, the last one partial.
+std::vector<std::vector<long>> chunks_of(const std::vector<long>& elements, size_t n)
+{
+	std::vector<std::vector<long>> accu;
+
+	for(size_t first=0; first<elements.size(); first+=n)
+		accu.emplace_back(elements.begin()+first, elements.begin()+std::min(first+n, elements.size()));
+
+	return accu;
+}
+
+
+// The whole windows of n consecutive elements of elements, starting every step elements.
+std::vector<std::vector<long>> windows_of(const std::vector<long>& elements, size_t n, size_t step)
+{
+	std::vector<std::vector<long>> accu;
+
+	for(size_t first=0; first+n<=elements.size(); first+=step)
+		accu.emplace_back(elements.begin()+first, elements.begin()+first+n);
+
+	return accu;
+}
+
+
+// The runs of consecutive elements of elements for which same_fn holds pairwise.
+std::vector<std::vector<long>> batches_of(const std::vector<long>& elements,
+	const std::function<bool (const long&, const long&)>& same_fn)
+{
+	std::vector<std::vector<long>> accu;
+
+	for(size_t i=0; i<elements.size(); ++i)
+		if(i==0 || !same_fn(elements[i-1], elements[i]))
+			accu.push_back(std::vector<long>(1, elements[i]));
+		else
+			accu.back().push_back(elements[i]);
+
+	return accu;
+}
+
+
+int main()
+{
+	std::function<bool (const long&, const long&)> equal=[](const long& left, const long& right){return left==right;};
+	std::function<bool (const long&, const long&)> rising=[](const long& left, const long& right){return left<right;};
+	std::function<bool (const long&, const long&)> never=[](const long&, const long&){return false;};
+
+	// Empty streams, streams shorter than a block, whole blocks, and a final partial block
+	const long sizes[]={0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 99, 100, 101, 1000};
+	const size_t widths[]={1, 2, 3, 4, 7, 100};
+	const size_t steps[]={1, 2, 3, 7, 8, 150};
+
+	for(long n : sizes)
+	{
+		lazy_stream<long> stream=runs(n);
+		std::vector<long> elements=stream.to_vector();
+
+		for(size_t width : widths)
+		{
+			expect(stream.chunk(width).to_vector()==chunks_of(elements, width), "chunk");
+
+			// Steps below, equal to and above the window size
+			for(size_t step : steps)
+				expect(stream.sliding(width, step).to_vector()==windows_of(elements, width, step), "sliding");
+		}
+
+		expect(stream.sliding(3).to_vector()==windows_of(elements, 3, 1), "sliding by default step");
+		expect(stream.batch_by(equal).to_vector()==batches_of(elements, equal), "batch_by equal");
+		expect(stream.batch_by(rising).to_vector()==batches_of(elements, rising), "batch_by rising");
+		expect(stream.batch_by(never).to_vector()==chunks_of(elements, 1), "batch_by of singletons");
+	}
+
+	// Infinite streams are cut lazily
+	lazy_stream<long> naturals=lazy_stream<long>::from(0);
+
+	expect(naturals.chunk(5).get(1000)==chunks_of(naturals.take(5005).to_vector(), 5).back(), "chunk of an infinite stream");
+	expect(naturals.sliding(5, 3).get(1000)==windows_of(naturals.take(3005).to_vector(), 5, 3).back(),
+		"sliding of an infinite stream");
+	expect(naturals.batch_by(never).get(1000)==std::vector<long>(1, 1000), "batch_by of an infinite stream");
+
+	expect_throw<std::invalid_argument>([](){runs(10).chunk(0);}, "chunk of no element");
+	expect_throw<std::invalid_argument>([](){runs(10).sliding(0);}, "window of no element");
+	expect_throw<std::invalid_argument>([](){runs(10).sliding(3, 0);}, "window with no step");
+
+	std::cout << "OK" << std::endl;
+
+	return 0;
+}
+
+// compile this> g++ -std=c++11 -O2 -pthread window_check.cpp -o window_check